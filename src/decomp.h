@@ -0,0 +1,504 @@
+// Copyright (c) 2017-2018 Nicola Asuni - Tecnick.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+/**
+ * @file decomp.h
+ * @brief In-process decompression of gzip and zstd input data.
+ *
+ * The compressed data is decoded on a dedicated thread into fixed-size
+ * blocks of a lock-free single-producer/single-consumer ring, so the
+ * decompression overlaps with the parsing of the previous blocks.
+ * A thread waiting for the other side spins briefly and then sleeps on a
+ * condition variable, so it doesn't burn a CPU core for the whole run.
+ *
+ * The gzip support requires zlib (HAVE_ZLIB) and the zstd support
+ * requires libzstd (HAVE_ZSTD).
+ */
+
+#ifndef WORDFREQ_DECOMP_H
+#define WORDFREQ_DECOMP_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#include <zstd_errors.h>
+#endif
+
+#define DECOMP_BLOCK_SIZE (1 << 18) //!< Default size in bytes of each decompressed block.
+#define DECOMP_RING_SIZE  8         //!< Number of blocks in the ring (power of 2).
+#ifndef DECOMP_SPIN
+#define DECOMP_SPIN       64        //!< Number of sched_yield() calls before sleeping on the condition variable.
+#endif
+#define RING_CONSUMER     0         //!< Index of the consumer side (parser thread).
+#define RING_PRODUCER     1         //!< Index of the producer side (decoder thread).
+
+/**
+ * Compression formats.
+ */
+enum
+{
+    COMP_NONE = 0, //!< Uncompressed data.
+    COMP_GZIP,     //!< gzip (RFC 1952).
+    COMP_ZSTD      //!< Zstandard (RFC 8878).
+};
+
+/**
+ * Decoder error codes.
+ */
+enum
+{
+    DECOMP_OK = 0,      //!< No error.
+    DECOMP_UNSUPPORTED, //!< The compression format is not supported by this build.
+    DECOMP_CORRUPTED,   //!< The compressed data is invalid or truncated.
+    DECOMP_NOMEM        //!< Unable to allocate memory.
+};
+
+/**
+ * Struct containing the decoder and the ring of decompressed blocks.
+ * The head and tail counters are only written by the producer and consumer thread respectively.
+ * The mutex and the condition variables are only used when one of the threads has to sleep.
+ * Each side has its own waiting flag and condition variable, indexed by RING_CONSUMER or RING_PRODUCER,
+ * so a thread waking up never hides the other one, which may be sleeping at the same time.
+ */
+typedef struct decoder_t
+{
+    const uint8_t *src;               //!< Compressed data.
+    uint64_t size;                    //!< Compressed data size in bytes.
+    uint8_t type;                     //!< Compression format (COMP_GZIP or COMP_ZSTD).
+    size_t blksize;                   //!< Size in bytes of each block.
+    uint8_t *data;                    //!< Memory for all the blocks.
+    size_t len[DECOMP_RING_SIZE];     //!< Number of bytes stored in each block.
+    uint32_t head;                    //!< Number of blocks produced.
+    uint32_t tail;                    //!< Number of blocks consumed.
+    int done;                         //!< Set to 1 by the producer when there are no more blocks.
+    int err;                          //!< Decoder error code (DECOMP_OK on success).
+    int waiting[2];                   //!< Set to 1 while the consumer or producer thread is sleeping.
+    pthread_mutex_t mutex;            //!< Mutex protecting the condition variables.
+    pthread_cond_t cond[2];           //!< Signaled when the ring changes while the consumer or producer is sleeping.
+    pthread_t thread;                 //!< Decoder thread.
+} decoder_t;
+
+/**
+ * Detect the compression format from the magic bytes.
+ *
+ * @param src  Pointer to the input data.
+ * @param size Input data size in bytes.
+ *
+ * @return Compression format: COMP_NONE, COMP_GZIP or COMP_ZSTD.
+ */
+static inline uint8_t get_compression(const uint8_t *src, uint64_t size)
+{
+    if ((size >= 2) && (src[0] == 0x1f) && (src[1] == 0x8b))
+    {
+        return COMP_GZIP;
+    }
+    if ((size >= 4) && (src[0] == 0x28) && (src[1] == 0xb5) && (src[2] == 0x2f) && (src[3] == 0xfd))
+    {
+        return COMP_ZSTD;
+    }
+    return COMP_NONE;
+}
+
+/**
+ * Returns the description of a decoder error code.
+ *
+ * @param err Decoder error code.
+ *
+ * @return Error description.
+ */
+static inline const char *decomp_strerror(int err)
+{
+    switch (err)
+    {
+    case DECOMP_OK:
+        return "success";
+    case DECOMP_UNSUPPORTED:
+        return "compression format not supported by this build";
+    case DECOMP_CORRUPTED:
+        return "invalid or truncated compressed data";
+    default:
+        return "unable to allocate memory";
+    }
+}
+
+/**
+ * Check if the calling thread can proceed without waiting.
+ * The producer needs a free block, the consumer needs a new block or the end of the data.
+ *
+ * @param dec  Pointer to the decoder.
+ * @param side RING_CONSUMER or RING_PRODUCER.
+ *
+ * @return True if the thread can proceed.
+ */
+static inline bool ring_ready(decoder_t *dec, uint8_t side)
+{
+    if (side == RING_PRODUCER)
+    {
+        return ((dec->head - __atomic_load_n(&dec->tail, __ATOMIC_SEQ_CST)) < DECOMP_RING_SIZE);
+    }
+    return ((dec->tail != __atomic_load_n(&dec->head, __ATOMIC_SEQ_CST)) || __atomic_load_n(&dec->done, __ATOMIC_SEQ_CST));
+}
+
+/**
+ * Wait until the calling thread can proceed: spin for a short time, then sleep on the condition variable.
+ * The waiting flag is set before the last check, and the other side reads it after updating the ring
+ * (both sequentially consistent), so at least one of the two sees the change of the other.
+ *
+ * @param dec  Pointer to the decoder.
+ * @param side Side of the calling thread: RING_CONSUMER or RING_PRODUCER.
+ */
+static inline void ring_wait(decoder_t *dec, uint8_t side)
+{
+    for (uint32_t i = DECOMP_SPIN; i > 0; i--)
+    {
+        if (ring_ready(dec, side))
+        {
+            return;
+        }
+        sched_yield();
+    }
+    pthread_mutex_lock(&dec->mutex);
+    __atomic_store_n(&dec->waiting[side], 1, __ATOMIC_SEQ_CST);
+    while (!ring_ready(dec, side))
+    {
+        pthread_cond_wait(&dec->cond[side], &dec->mutex);
+    }
+    __atomic_store_n(&dec->waiting[side], 0, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&dec->mutex);
+}
+
+/**
+ * Wake up the specified side if it is sleeping in ring_wait().
+ * It must be called after updating the head, tail or done fields.
+ *
+ * @param dec  Pointer to the decoder.
+ * @param side Side to wake up: RING_CONSUMER or RING_PRODUCER.
+ */
+static inline void ring_wake(decoder_t *dec, uint8_t side)
+{
+    if (__atomic_load_n(&dec->waiting[side], __ATOMIC_SEQ_CST))
+    {
+        pthread_mutex_lock(&dec->mutex);
+        pthread_cond_signal(&dec->cond[side]);
+        pthread_mutex_unlock(&dec->mutex);
+    }
+}
+
+/**
+ * Returns the next free block, waiting for the consumer if the ring is full (producer side).
+ *
+ * @param dec Pointer to the decoder.
+ *
+ * @return Pointer to the free block.
+ */
+static inline uint8_t *ring_reserve(decoder_t *dec)
+{
+    if (!ring_ready(dec, RING_PRODUCER))
+    {
+        ring_wait(dec, RING_PRODUCER);
+    }
+    return dec->data + ((dec->head % DECOMP_RING_SIZE) * dec->blksize);
+}
+
+/**
+ * Publish the block returned by ring_reserve() (producer side).
+ *
+ * @param dec Pointer to the decoder.
+ * @param len Number of bytes stored in the block.
+ */
+static inline void ring_publish(decoder_t *dec, size_t len)
+{
+    if (len == 0)
+    {
+        return;
+    }
+    dec->len[dec->head % DECOMP_RING_SIZE] = len;
+    __atomic_store_n(&dec->head, dec->head + 1, __ATOMIC_SEQ_CST);
+    ring_wake(dec, RING_CONSUMER);
+}
+
+/**
+ * Check if the data contains only zero bytes.
+ *
+ * @param src  Pointer to the data.
+ * @param size Data size in bytes.
+ *
+ * @return True if all the bytes are zero (or the size is 0).
+ */
+static inline bool is_zero_padding(const uint8_t *src, uint64_t size)
+{
+    for (uint64_t i = 0; i < size; i++)
+    {
+        if (src[i] != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef HAVE_ZLIB
+/**
+ * Decode gzip data into the ring, including multiple concatenated members.
+ * Trailing zero bytes after the last member are ignored, like gzip does.
+ *
+ * @param dec Pointer to the decoder.
+ *
+ * @return Decoder error code.
+ */
+static inline int decode_gzip(decoder_t *dec)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 15 + 16) != Z_OK)
+    {
+        return DECOMP_NOMEM;
+    }
+    const uint8_t *src = dec->src;
+    uint64_t left = dec->size;
+    int ret = Z_OK;
+    for (;;)
+    {
+        if ((zs.avail_in == 0) && (left > 0))
+        {
+            uInt n = (left > (1U << 30)) ? (1U << 30) : (uInt)left;
+            zs.next_in = (Bytef *)(uintptr_t)src; // zlib does not modify the input data
+            zs.avail_in = n;
+            src += n;
+            left -= n;
+        }
+        zs.next_out = ring_reserve(dec);
+        zs.avail_out = (uInt)dec->blksize;
+        ret = inflate(&zs, Z_NO_FLUSH);
+        ring_publish(dec, dec->blksize - zs.avail_out);
+        if (ret == Z_STREAM_END)
+        {
+            // the remaining input is contiguous: the current window is followed by the data left
+            if (is_zero_padding(zs.next_in, (uint64_t)zs.avail_in + left))
+            {
+                break;
+            }
+            // concatenated gzip member
+            if (inflateReset(&zs) != Z_OK)
+            {
+                break;
+            }
+            continue;
+        }
+        if ((ret != Z_OK) && (ret != Z_BUF_ERROR))
+        {
+            break;
+        }
+        if ((ret == Z_BUF_ERROR) && (zs.avail_in == 0) && (left == 0))
+        {
+            break;
+        }
+    }
+    inflateEnd(&zs);
+    return (ret == Z_STREAM_END) ? DECOMP_OK : ((ret == Z_MEM_ERROR) ? DECOMP_NOMEM : DECOMP_CORRUPTED);
+}
+#endif
+
+#ifdef HAVE_ZSTD
+/**
+ * Decode zstd data into the ring, including multiple concatenated frames.
+ *
+ * @param dec Pointer to the decoder.
+ *
+ * @return Decoder error code.
+ */
+static inline int decode_zstd(decoder_t *dec)
+{
+    ZSTD_DStream *zds = ZSTD_createDStream();
+    if (!zds)
+    {
+        return DECOMP_NOMEM;
+    }
+    ZSTD_inBuffer in = {dec->src, (size_t)dec->size, 0};
+    size_t ret = ZSTD_initDStream(zds);
+    while (!ZSTD_isError(ret))
+    {
+        ZSTD_outBuffer out = {ring_reserve(dec), dec->blksize, 0};
+        ret = ZSTD_decompressStream(zds, &out, &in);
+        if (ZSTD_isError(ret))
+        {
+            break;
+        }
+        ring_publish(dec, out.pos);
+        // all the input is consumed and the last frame is complete, or no more data can be flushed
+        if ((in.pos == in.size) && ((ret == 0) || (out.pos < out.size)))
+        {
+            break;
+        }
+    }
+    ZSTD_freeDStream(zds);
+    if (ret == 0)
+    {
+        return DECOMP_OK;
+    }
+    return (ZSTD_isError(ret) && (ZSTD_getErrorCode(ret) == ZSTD_error_memory_allocation)) ? DECOMP_NOMEM : DECOMP_CORRUPTED;
+}
+#endif
+
+/**
+ * Decoder thread entry point.
+ *
+ * @param arg Pointer to the decoder.
+ *
+ * @return Always NULL.
+ */
+static inline void *decoder_thread(void *arg)
+{
+    decoder_t *dec = (decoder_t *)arg;
+    int err = DECOMP_UNSUPPORTED;
+    switch (dec->type)
+    {
+#ifdef HAVE_ZLIB
+    case COMP_GZIP:
+        err = decode_gzip(dec);
+        break;
+#endif
+#ifdef HAVE_ZSTD
+    case COMP_ZSTD:
+        err = decode_zstd(dec);
+        break;
+#endif
+    default:
+        break;
+    }
+    dec->err = err;
+    __atomic_store_n(&dec->done, 1, __ATOMIC_SEQ_CST);
+    ring_wake(dec, RING_CONSUMER);
+    return NULL;
+}
+
+/**
+ * Create a new decoder and start the decoding thread.
+ *
+ * @param src     Compressed data.
+ * @param size    Compressed data size in bytes.
+ * @param type    Compression format (COMP_GZIP or COMP_ZSTD).
+ * @param blksize Size in bytes of each decompressed block.
+ *
+ * @return Pointer to the new decoder, or NULL in case of error.
+ */
+static inline decoder_t *new_decoder(const uint8_t *src, uint64_t size, uint8_t type, size_t blksize)
+{
+    decoder_t *dec = (decoder_t *)malloc(sizeof(decoder_t));
+    if (!dec)
+    {
+        return NULL;
+    }
+    dec->src = src;
+    dec->size = size;
+    dec->type = type;
+    dec->blksize = (blksize > 0) ? blksize : DECOMP_BLOCK_SIZE;
+    dec->head = 0;
+    dec->tail = 0;
+    dec->done = 0;
+    dec->err = DECOMP_OK;
+    dec->waiting[RING_CONSUMER] = 0;
+    dec->waiting[RING_PRODUCER] = 0;
+    dec->data = (uint8_t *)malloc(dec->blksize * DECOMP_RING_SIZE);
+    if (!dec->data)
+    {
+        free(dec);
+        return NULL;
+    }
+    pthread_mutex_init(&dec->mutex, NULL);
+    pthread_cond_init(&dec->cond[RING_CONSUMER], NULL);
+    pthread_cond_init(&dec->cond[RING_PRODUCER], NULL);
+    if (pthread_create(&dec->thread, NULL, decoder_thread, dec) != 0)
+    {
+        pthread_cond_destroy(&dec->cond[RING_CONSUMER]);
+        pthread_cond_destroy(&dec->cond[RING_PRODUCER]);
+        pthread_mutex_destroy(&dec->mutex);
+        free(dec->data);
+        free(dec);
+        return NULL;
+    }
+    return dec;
+}
+
+/**
+ * Returns the next decompressed block, waiting for the decoder if required (consumer side).
+ * The block must be released with decoder_release() after use.
+ *
+ * @param dec Pointer to the decoder.
+ * @param len Returns the number of bytes in the block.
+ *
+ * @return Pointer to the block data, or NULL when there are no more blocks.
+ */
+static inline const uint8_t *decoder_next(decoder_t *dec, size_t *len)
+{
+    if (dec->tail == __atomic_load_n(&dec->head, __ATOMIC_SEQ_CST))
+    {
+        ring_wait(dec, RING_CONSUMER);
+        // check again, as the last block could have been published before done
+        if (dec->tail == __atomic_load_n(&dec->head, __ATOMIC_SEQ_CST))
+        {
+            return NULL;
+        }
+    }
+    uint32_t slot = dec->tail % DECOMP_RING_SIZE;
+    *len = dec->len[slot];
+    return dec->data + (slot * dec->blksize);
+}
+
+/**
+ * Release the block returned by decoder_next() (consumer side).
+ *
+ * @param dec Pointer to the decoder.
+ */
+static inline void decoder_release(decoder_t *dec)
+{
+    __atomic_store_n(&dec->tail, dec->tail + 1, __ATOMIC_SEQ_CST);
+    ring_wake(dec, RING_PRODUCER);
+}
+
+/**
+ * Wait for the decoding thread to terminate and free the decoder.
+ * All the blocks must have been consumed before calling this function.
+ *
+ * @param dec Pointer to the decoder.
+ *
+ * @return Decoder error code (DECOMP_OK on success).
+ */
+static inline int free_decoder(decoder_t *dec)
+{
+    pthread_join(dec->thread, NULL);
+    int err = dec->err;
+    pthread_cond_destroy(&dec->cond[RING_CONSUMER]);
+    pthread_cond_destroy(&dec->cond[RING_PRODUCER]);
+    pthread_mutex_destroy(&dec->mutex);
+    free(dec->data);
+    free(dec);
+    return err;
+}
+
+#endif  // WORDFREQ_DECOMP_H
@@ -44,6 +44,8 @@ typedef struct mmfile_t
 
 /**
  * Memory map the specified file.
+ * An empty regular file can't be mapped: in this case src is set to NULL and size to 0.
+ * Other files reporting a zero size (pipes, FIFOs, devices, procfs) are not supported, and src is set to MAP_FAILED.
  *
  * @param file  Path to the file to map.
  * @param mf    Structure containing the memory mapped file.
@@ -56,11 +58,25 @@ static inline void mmap_file(const char *file, mmfile_t *mf)
     mf->fd = -1;
     mf->size = 0;
     struct stat statbuf;
-    if (((mf->fd = open(file, O_RDONLY)) < 0) || (fstat(mf->fd, &statbuf) < 0))
+    if ((mf->fd = open(file, O_RDONLY)) < 0)
     {
         return;
     }
+    if (fstat(mf->fd, &statbuf) < 0)
+    {
+        close(mf->fd);
+        mf->fd = -1;
+        return;
+    }
     mf->size = (uint64_t)statbuf.st_size;
+    if (mf->size == 0)
+    {
+        if (S_ISREG(statbuf.st_mode))
+        {
+            mf->src = NULL;
+        }
+        return;
+    }
     mf->src = (uint8_t *)mmap(0, mf->size, PROT_READ, MAP_PRIVATE, mf->fd, 0);
 }
 
@@ -82,4 +98,21 @@ static inline int munmap_file(mmfile_t mf)
     return close(mf.fd);
 }
 
+/**
+ * Unmap and close the memory-mapped file.
+ * If the file is empty or has not been mapped, it is only closed.
+ *
+ * @param mf Descriptor of memory-mapped file.
+ *
+ * @return On success 0, on failure -1, and errno is set.
+ */
+static inline int close_mmfile(mmfile_t mf)
+{
+    if ((mf.size == 0) || (mf.src == MAP_FAILED))
+    {
+        return close(mf.fd);
+    }
+    return munmap_file(mf);
+}
+
 #endif  // WORDFREQ_MMAP_H
@@ -0,0 +1,387 @@
+// Copyright (c) 2017-2018 Nicola Asuni - Tecnick.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+/**
+ * @file outbuf.h
+ * @brief Buffered writer for the (frequency, word) output records.
+ *
+ * The records are formatted directly into a single large buffer using a
+ * hand-rolled integer formatter, and the buffer is written to the output
+ * file descriptor only when full, so no stdio or locale handling is involved.
+ *
+ * Supported formats:
+ *   - txt  : "%10u word\n" (default, same as the original output);
+ *   - tsv  : "count\tword\n";
+ *   - csv  : "count,word\n";
+ *   - json : array of {"count":N,"word":"W"} objects, one per line;
+ *   - bin  : sequence of records, each one composed by the count and the
+ *            word length as 32 bit little-endian unsigned integers,
+ *            followed by the word bytes (not NULL-terminated).
+ *
+ * Words only contain characters in the range ['a','z'], so no escaping is required.
+ */
+
+#ifndef WORDFREQ_OUTBUF_H
+#define WORDFREQ_OUTBUF_H
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#define OUTBUF_SIZE    (1 << 20)  //!< Default output buffer size in bytes.
+#define OUTBUF_RECMAX  32         //!< Maximum size of a record excluding the word.
+
+/**
+ * Output formats.
+ */
+enum
+{
+    FORMAT_TXT = 0, //!< Fixed-width text (default).
+    FORMAT_TSV,     //!< Tab-separated values.
+    FORMAT_CSV,     //!< Comma-separated values.
+    FORMAT_JSON,    //!< JSON array of objects.
+    FORMAT_BIN,     //!< Binary records.
+    FORMAT_INVALID  //!< Unsupported format.
+};
+
+/**
+ * Struct containing the output buffer.
+ */
+typedef struct outbuf_t
+{
+    int fd;         //!< Output file descriptor.
+    int err;        //!< Last write error (errno value), 0 if none.
+    uint8_t format; //!< Output format.
+    uint64_t nrec;  //!< Number of records written.
+    size_t len;     //!< Number of bytes currently stored in the buffer.
+    size_t size;    //!< Buffer size in bytes.
+    char *buf;      //!< Buffer data.
+} outbuf_t;
+
+/**
+ * Returns the format code for the specified format name.
+ *
+ * @param name Format name: "txt", "tsv", "csv", "json" or "bin".
+ *
+ * @return Format code, or FORMAT_INVALID if the name is not supported.
+ */
+static inline uint8_t get_format(const char *name)
+{
+    static const char *names[] = {"txt", "tsv", "csv", "json", "bin"};
+    for (uint8_t i = 0; i < FORMAT_INVALID; i++)
+    {
+        if (strcmp(name, names[i]) == 0)
+        {
+            return i;
+        }
+    }
+    return FORMAT_INVALID;
+}
+
+/**
+ * Format an unsigned integer as decimal string, writing the digits backwards.
+ *
+ * @param end Pointer to the position after the last digit (at least 10 bytes are available before).
+ * @param v   Value to format.
+ *
+ * @return Number of written characters.
+ */
+static inline uint8_t format_uint32_rev(char *end, uint32_t v)
+{
+    static const char digits[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    char *dst = end;
+    while (v >= 100)
+    {
+        uint32_t d = (v % 100) * 2;
+        v /= 100;
+        *--dst = digits[d + 1];
+        *--dst = digits[d];
+    }
+    if (v >= 10)
+    {
+        *--dst = digits[(v * 2) + 1];
+        *--dst = digits[v * 2];
+    }
+    else
+    {
+        *--dst = (char)('0' + v);
+    }
+    return (uint8_t)(end - dst);
+}
+
+/**
+ * Format an unsigned integer as decimal string.
+ *
+ * @param dst Destination buffer (at least 10 bytes). The result is not NULL-terminated.
+ * @param v   Value to format.
+ *
+ * @return Number of written characters.
+ */
+static inline uint8_t format_uint32(char *dst, uint32_t v)
+{
+    char tmp[10];
+    uint8_t len = format_uint32_rev(tmp + sizeof(tmp), v);
+    memcpy(dst, tmp + sizeof(tmp) - len, len);
+    return len;
+}
+
+/**
+ * Encode an unsigned integer as 32 bit little-endian.
+ *
+ * @param dst Destination buffer (at least 4 bytes).
+ * @param v   Value to encode.
+ */
+static inline void encode_uint32le(char *dst, uint32_t v)
+{
+    dst[0] = (char)(v & 0xff);
+    dst[1] = (char)((v >> 8) & 0xff);
+    dst[2] = (char)((v >> 16) & 0xff);
+    dst[3] = (char)((v >> 24) & 0xff);
+}
+
+/**
+ * Write all the data described by an I/O vector, retrying on partial writes.
+ *
+ * @param fd  Output file descriptor.
+ * @param iov I/O vector (modified).
+ * @param cnt Number of elements in the I/O vector.
+ *
+ * @return 0 in case of success, otherwise the errno value.
+ */
+static inline int write_iov(int fd, struct iovec *iov, int cnt)
+{
+    while (cnt > 0)
+    {
+        ssize_t n = writev(fd, iov, cnt);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return errno;
+        }
+        while ((cnt > 0) && ((size_t)n >= iov->iov_len))
+        {
+            n -= (ssize_t)iov->iov_len;
+            ++iov;
+            --cnt;
+        }
+        if (cnt > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Returns a new output buffer.
+ *
+ * @param fd     Output file descriptor.
+ * @param format Output format.
+ * @param size   Buffer size in bytes (at least OUTBUF_RECMAX).
+ *
+ * @return Pointer to the new output buffer, or NULL in case of error.
+ */
+static inline outbuf_t *new_outbuf(int fd, uint8_t format, size_t size)
+{
+    outbuf_t *ob = (outbuf_t *)malloc(sizeof(outbuf_t));
+    if (!ob)
+    {
+        return NULL;
+    }
+    if (size < OUTBUF_RECMAX)
+    {
+        size = OUTBUF_RECMAX;
+    }
+    ob->buf = (char *)malloc(size);
+    if (!ob->buf)
+    {
+        free(ob);
+        return NULL;
+    }
+    ob->fd = fd;
+    ob->err = 0;
+    ob->format = format;
+    ob->nrec = 0;
+    ob->len = 0;
+    ob->size = size;
+    return ob;
+}
+
+/**
+ * Free the output buffer (the buffered data is discarded).
+ *
+ * @param ob Pointer to the output buffer.
+ */
+static inline void free_outbuf(outbuf_t *ob)
+{
+    free(ob->buf);
+    free(ob);
+}
+
+/**
+ * Write the buffered data to the output file descriptor.
+ *
+ * @param ob Pointer to the output buffer.
+ *
+ * @return 0 in case of success, otherwise the errno value.
+ */
+static inline int outbuf_flush(outbuf_t *ob)
+{
+    if ((ob->len > 0) && (ob->err == 0))
+    {
+        struct iovec iov;
+        iov.iov_base = ob->buf;
+        iov.iov_len = ob->len;
+        ob->err = write_iov(ob->fd, &iov, 1);
+    }
+    ob->len = 0;
+    return ob->err;
+}
+
+/**
+ * Append raw data to the output buffer.
+ * Data that does not fit in the buffer is written together with the buffered data in a single call, without copy.
+ *
+ * @param ob   Pointer to the output buffer.
+ * @param data Data to append.
+ * @param len  Data length in bytes.
+ */
+static inline void outbuf_write(outbuf_t *ob, const char *data, size_t len)
+{
+    if (len <= (ob->size - ob->len))
+    {
+        memcpy(ob->buf + ob->len, data, len);
+        ob->len += len;
+        return;
+    }
+    if (ob->err == 0)
+    {
+        struct iovec iov[2];
+        iov[0].iov_base = ob->buf;
+        iov[0].iov_len = ob->len;
+        iov[1].iov_base = (void *)(uintptr_t)data; // writev does not modify the data
+        iov[1].iov_len = len;
+        ob->err = write_iov(ob->fd, iov, 2);
+    }
+    ob->len = 0;
+}
+
+/**
+ * Write the output header, if required by the format.
+ *
+ * @param ob Pointer to the output buffer.
+ */
+static inline void outbuf_begin(outbuf_t *ob)
+{
+    ob->nrec = 0;
+    if (ob->format == FORMAT_JSON)
+    {
+        outbuf_write(ob, "[", 1);
+    }
+}
+
+/**
+ * Append a (frequency, word) record to the output buffer.
+ *
+ * @param ob   Pointer to the output buffer.
+ * @param freq Word frequency.
+ * @param word Word (not necessarily NULL-terminated).
+ * @param len  Word length in bytes.
+ */
+static inline void outbuf_record(outbuf_t *ob, uint32_t freq, const char *word, size_t len)
+{
+    if ((ob->size - ob->len) < (OUTBUF_RECMAX + len))
+    {
+        outbuf_flush(ob);
+    }
+    char *dst;
+    uint8_t n;
+    switch (ob->format)
+    {
+    case FORMAT_TSV:
+    case FORMAT_CSV:
+        dst = ob->buf + ob->len;
+        n = format_uint32(dst, freq);
+        dst[n] = (ob->format == FORMAT_TSV) ? '\t' : ',';
+        ob->len += (size_t)n + 1;
+        outbuf_write(ob, word, len);
+        outbuf_write(ob, "\n", 1);
+        break;
+    case FORMAT_JSON:
+        dst = ob->buf + ob->len;
+        if (ob->nrec > 0)
+        {
+            *dst++ = ',';
+        }
+        memcpy(dst, "\n{\"count\":", 10);
+        dst += 10;
+        dst += format_uint32(dst, freq);
+        memcpy(dst, ",\"word\":\"", 9);
+        dst += 9;
+        ob->len = (size_t)(dst - ob->buf);
+        outbuf_write(ob, word, len);
+        outbuf_write(ob, "\"}", 2);
+        break;
+    case FORMAT_BIN:
+        dst = ob->buf + ob->len;
+        encode_uint32le(dst, freq);
+        encode_uint32le(dst + 4, (uint32_t)len);
+        ob->len += 8;
+        outbuf_write(ob, word, len);
+        break;
+    default: // FORMAT_TXT
+        dst = ob->buf + ob->len;
+        memset(dst, ' ', 11);
+        format_uint32_rev(dst + 10, freq);
+        ob->len += 11;
+        outbuf_write(ob, word, len);
+        outbuf_write(ob, "\n", 1);
+        break;
+    }
+    ++(ob->nrec);
+}
+
+/**
+ * Write the output footer, if required by the format, and flush the buffer.
+ *
+ * @param ob Pointer to the output buffer.
+ *
+ * @return 0 in case of success, otherwise the errno value of the first write error.
+ */
+static inline int outbuf_end(outbuf_t *ob)
+{
+    if (ob->format == FORMAT_JSON)
+    {
+        outbuf_write(ob, "\n]\n", 3);
+    }
+    return outbuf_flush(ob);
+}
+
+#endif  // WORDFREQ_OUTBUF_H
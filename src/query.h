@@ -0,0 +1,407 @@
+// Copyright (c) 2017-2018 Nicola Asuni - Tecnick.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+/**
+ * @file query.h
+ * @brief Functions to count only the occurrences of a given list of words.
+ *
+ * A static trie (deterministic automaton) is built only from the query words,
+ * with the nodes stored in a contiguous transition table. The input is then
+ * scanned against it: words that are not in the query list fall into a
+ * "dead" state that loops on itself, so they are skipped without allocating
+ * memory, and the memory usage is proportional to the size of the query list.
+ */
+
+#ifndef WORDFREQ_QUERY_H
+#define WORDFREQ_QUERY_H
+
+#include "wordfreq.h"
+
+#define QUERY_DEAD 0 //!< Dead state: the current word is not a prefix of any query word.
+#define QUERY_ROOT 1 //!< Initial state.
+
+/**
+ * Struct containing the query automaton and the word counters.
+ */
+typedef struct query_t
+{
+    uint32_t nnodes;                   //!< Number of automaton states (nodes).
+    uint32_t maxnodes;                 //!< Number of allocated states.
+    uint32_t (*next)[ALPHABET_SIZE];   //!< Transition table: next state for each state and character index.
+    uint32_t *wid;                     //!< Query word index for each state (0 = not the end of a query word).
+    uint32_t nwords;                   //!< Number of distinct query words.
+    uint32_t maxwords;                 //!< Number of allocated words.
+    uint32_t *freq;                    //!< Frequency of each query word, starting at index 1 (index 0 is discarded).
+    uint64_t *woff;                    //!< Offset of each query word in the words buffer, starting at index 1.
+    char *words;                       //!< Query words, in the same order as in the query list.
+    uint64_t wlen;                     //!< Length of the words buffer in bytes.
+    uint64_t wmax;                     //!< Allocated size of the words buffer in bytes.
+} query_t;
+
+/**
+ * Free the query object.
+ *
+ * @param q Pointer to the query object.
+ */
+static inline void free_query(query_t *q)
+{
+    free(q->next);
+    free(q->wid);
+    free(q->freq);
+    free(q->woff);
+    free(q->words);
+    free(q);
+}
+
+/**
+ * Add a new state to the query automaton.
+ *
+ * @param q Pointer to the query object.
+ *
+ * @return Index of the new state, or QUERY_DEAD in case of error.
+ */
+static inline uint32_t add_query_node(query_t *q)
+{
+    if (q->nnodes == q->maxnodes)
+    {
+        uint32_t max = (q->maxnodes > 0) ? (q->maxnodes * 2) : 64;
+        uint32_t (*next)[ALPHABET_SIZE] = (uint32_t (*)[ALPHABET_SIZE])realloc(q->next, (uint64_t)max * sizeof(*next));
+        if (!next)
+        {
+            return QUERY_DEAD;
+        }
+        q->next = next;
+        uint32_t *wid = (uint32_t *)realloc(q->wid, (uint64_t)max * sizeof(uint32_t));
+        if (!wid)
+        {
+            return QUERY_DEAD;
+        }
+        q->wid = wid;
+        q->maxnodes = max;
+    }
+    uint32_t n = q->nnodes++;
+    memset(q->next[n], 0, sizeof(q->next[n]));
+    q->wid[n] = 0;
+    return n;
+}
+
+/**
+ * Add a word to the query list.
+ *
+ * @param q    Pointer to the query object.
+ * @param word Word characters (only letters).
+ * @param len  Word length.
+ *
+ * @return 0 in case of success, 1 in case of memory allocation error.
+ */
+static inline int add_query_word(query_t *q, const uint8_t *word, uint64_t len)
+{
+    uint32_t node = QUERY_ROOT;
+    for (uint64_t i = 0; i < len; i++)
+    {
+        uint8_t idx = get_char_index(word[i]);
+        if (q->next[node][idx] == QUERY_DEAD)
+        {
+            uint32_t n = add_query_node(q);
+            if (n == QUERY_DEAD)
+            {
+                return 1;
+            }
+            q->next[node][idx] = n;
+        }
+        node = q->next[node][idx];
+    }
+    if (q->wid[node] != 0)
+    {
+        return 0; // duplicate
+    }
+    if (q->nwords + 1 == q->maxwords)
+    {
+        uint32_t max = q->maxwords * 2;
+        uint32_t *freq = (uint32_t *)realloc(q->freq, (uint64_t)max * sizeof(uint32_t));
+        if (!freq)
+        {
+            return 1;
+        }
+        q->freq = freq;
+        uint64_t *woff = (uint64_t *)realloc(q->woff, ((uint64_t)max + 1) * sizeof(uint64_t));
+        if (!woff)
+        {
+            return 1;
+        }
+        q->woff = woff;
+        q->maxwords = max;
+    }
+    if ((q->wlen + len) > q->wmax)
+    {
+        uint64_t max = (q->wmax * 2) + len;
+        char *words = (char *)realloc(q->words, max);
+        if (!words)
+        {
+            return 1;
+        }
+        q->words = words;
+        q->wmax = max;
+    }
+    for (uint64_t i = 0; i < len; i++)
+    {
+        q->words[q->wlen + i] = (char)get_index_char(get_char_index(word[i]));
+    }
+    q->wlen += len;
+    q->wid[node] = ++(q->nwords);
+    q->freq[q->nwords] = 0;
+    q->woff[q->nwords + 1] = q->wlen;
+    return 0;
+}
+
+/**
+ * Returns a new query object built from a list of words.
+ * The words are extracted from the list using the same rules used to parse the input.
+ *
+ * @param src  Pointer to the query list data.
+ * @param size Query list size in bytes.
+ *
+ * @return Pointer to the new query object, or NULL in case of error.
+ */
+static inline query_t *new_query(const uint8_t *src, uint64_t size)
+{
+    query_t *q = (query_t *)calloc(1, sizeof(query_t));
+    if (!q)
+    {
+        return NULL;
+    }
+    q->maxwords = 64;
+    q->freq = (uint32_t *)malloc(q->maxwords * sizeof(uint32_t));
+    q->woff = (uint64_t *)malloc((q->maxwords + 1) * sizeof(uint64_t));
+    add_query_node(q); // QUERY_DEAD, all its transitions point to itself
+    if (!q->freq || !q->woff || (add_query_node(q) != QUERY_ROOT))
+    {
+        free_query(q);
+        return NULL;
+    }
+    q->freq[0] = 0;
+    q->woff[0] = 0;
+    q->woff[1] = 0;
+    uint64_t start = 0;
+    for (uint64_t i = 0; i <= size; i++)
+    {
+        uint8_t idx = (i < size) ? get_char_index(src[i]) : NOCH;
+        if (idx == NOCH)
+        {
+            if ((i > start) && (add_query_word(q, src + start, i - start) != 0))
+            {
+                free_query(q);
+                return NULL;
+            }
+            start = i + 1;
+        }
+    }
+    return q;
+}
+
+/**
+ * Scan a chunk of input data and count the occurrences of the query words.
+ *
+ * @param q     Pointer to the query object.
+ * @param state Pointer to the automaton state, preserved across consecutive chunks (initially QUERY_ROOT).
+ * @param src   Pointer to the input data.
+ * @param size  Input data size in bytes.
+ */
+static inline void query_chunk(query_t *q, uint32_t *state, const uint8_t *src, uint64_t size)
+{
+    uint32_t (*next)[ALPHABET_SIZE] = q->next;
+    const uint32_t *wid = q->wid;
+    uint32_t *freq = q->freq;
+    uint32_t node = *state;
+    for (uint64_t i = 0; i < size; i++)
+    {
+        uint8_t idx = get_char_index(*src++);
+        if (idx == NOCH)
+        {
+            // freq[0] collects the separators and the words not in the query list
+            ++freq[wid[node]];
+            node = QUERY_ROOT;
+            continue;
+        }
+        node = next[node][idx];
+    }
+    *state = node;
+}
+
+/**
+ * Terminate the scan, counting the last word.
+ *
+ * @param q     Pointer to the query object.
+ * @param state Pointer to the automaton state.
+ */
+static inline void query_finish(query_t *q, uint32_t *state)
+{
+    ++(q->freq[q->wid[*state]]);
+    *state = QUERY_ROOT;
+}
+
+/**
+ * Scan the input data, decompressing it on a separate thread if it is gzip or zstd compressed.
+ *
+ * @param q       Pointer to the query object.
+ * @param src     Pointer to the memory mapped file data.
+ * @param size    File size in bytes.
+ * @param blksize Size in bytes of the decompressed blocks (0 = DECOMP_BLOCK_SIZE).
+ *
+ * @return Decoder error code (DECOMP_OK on success).
+ */
+static inline int query_input(query_t *q, const uint8_t *src, uint64_t size, size_t blksize)
+{
+    uint32_t state = QUERY_ROOT;
+    uint8_t type = get_compression(src, size);
+    if (type == COMP_NONE)
+    {
+        query_chunk(q, &state, src, size);
+        query_finish(q, &state);
+        return DECOMP_OK;
+    }
+    decoder_t *dec = new_decoder(src, size, type, blksize);
+    if (!dec)
+    {
+        return DECOMP_NOMEM;
+    }
+    const uint8_t *blk;
+    size_t len = 0;
+    while ((blk = decoder_next(dec, &len)) != NULL)
+    {
+        query_chunk(q, &state, blk, len);
+        decoder_release(dec);
+    }
+    query_finish(q, &state);
+    return free_decoder(dec);
+}
+
+/**
+ * Print the query words with their frequency, in the same order as in the query list.
+ *
+ * @param q  Pointer to the query object.
+ * @param ob Output buffer.
+ */
+static inline void print_query(const query_t *q, outbuf_t *ob)
+{
+    for (uint32_t i = 1; i <= q->nwords; i++)
+    {
+        outbuf_record(ob, q->freq[i], q->words + q->woff[i], (size_t)(q->woff[i + 1] - q->woff[i]));
+    }
+}
+
+/**
+ * Parse an input file and print the frequency of each word in the query file.
+ *
+ * @param file   File to parse.
+ * @param qfile  File containing the list of words to count.
+ * @param format Output format (FORMAT_TXT, FORMAT_TSV, FORMAT_CSV, FORMAT_JSON or FORMAT_BIN).
+ *
+ * @return Error code, 0 in case of success.
+ */
+static inline int wordfreq_query(const char *file, const char *qfile, uint8_t format)
+{
+    // build the query automaton
+    mmfile_t qf = {0,0,0};
+    mmap_file(qfile, &qf);
+    if ((qf.fd < 0) || (qf.src == MAP_FAILED))
+    {
+        fprintf(stderr, "ERROR: can't read '%s' query file.\n", qfile);
+        if (qf.fd >= 0)
+        {
+            close_mmfile(qf);
+        }
+        return 9;
+    }
+    query_t *q = new_query(qf.src, qf.size);
+    close_mmfile(qf);
+    if (!q)
+    {
+        fprintf(stderr, "ERROR: Unable to allocate memory.\n");
+        return 5;
+    }
+
+    // memory-map the input file
+    mmfile_t mf = {0,0,0};
+    mmap_file(file, &mf);
+    if (mf.fd < 0)
+    {
+        fprintf(stderr, "ERROR: can't open '%s' file.\n", file);
+        free_query(q);
+        return 1;
+    }
+    if (mf.src == MAP_FAILED)
+    {
+        if (mf.size == 0)
+        {
+            fprintf(stderr, "ERROR: '%s' is not a regular file.\n", file);
+            free_query(q);
+            close_mmfile(mf);
+            return 2;
+        }
+        fprintf(stderr, "ERROR: mmap [%s]\n", strerror(errno));
+        free_query(q);
+        close_mmfile(mf);
+        return 3;
+    }
+
+    outbuf_t *ob = new_outbuf(STDOUT_FILENO, format, OUTBUF_SIZE);
+    if (!ob)
+    {
+        fprintf(stderr, "ERROR: Unable to allocate memory.\n");
+        free_query(q);
+        close_mmfile(mf);
+        return 5;
+    }
+
+    int de = query_input(q, mf.src, mf.size, DECOMP_BLOCK_SIZE);
+
+    int oe = 0;
+    if (de == DECOMP_OK)
+    {
+        outbuf_begin(ob);
+        print_query(q, ob);
+        oe = outbuf_end(ob);
+    }
+
+    free_outbuf(ob);
+    free_query(q);
+
+    // unmap the file
+    int e = close_mmfile(mf);
+    if (e != 0)
+    {
+        fprintf(stderr, "Got %s error while unmapping the %s file\n", strerror(errno), file);
+        return 6;
+    }
+    if (de != DECOMP_OK)
+    {
+        fprintf(stderr, "ERROR: can't decompress '%s' file [%s]\n", file, decomp_strerror(de));
+        return 8;
+    }
+    if (oe != 0)
+    {
+        fprintf(stderr, "ERROR: write [%s]\n", strerror(oe));
+        return 7;
+    }
+    return 0;
+}
+
+#endif  // WORDFREQ_QUERY_H
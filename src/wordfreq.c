@@ -40,7 +40,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "wordfreq.h"
+#include <stdbool.h>
+#include "query.h"
 
 #ifndef VERSION
 #define VERSION "0.0.0-0"
@@ -48,19 +49,71 @@
 
 #define MAX_RETURN_VALUES 20  //!< Default maximum number of words to return.
 
+static void usage()
+{
+    fprintf(stderr, "WordFreq %s\n\
+            Find the most frequently used words with their frequency.\n\
+            Usage: wordfreq [OPTIONS] <INPUT_FILE> [MAX_RESULTS]\n\
+            Options:\n\
+              -f, --format FORMAT  Output format: txt (default), tsv, csv, json, bin\n\
+              -a, --all            Print all the words in alphabetical order\n\
+              -q, --query FILE     Only count the words listed in FILE (not with -a or MAX_RESULTS)\n", VERSION);
+}
+
 int main(int argc, char *argv[])
 {
     uint8_t k = MAX_RETURN_VALUES;
-    if (argc > 2)
+    uint8_t format = FORMAT_TXT;
+    bool all = false;
+    const char *qfile = NULL;
+    const char *args[2] = {NULL, NULL};
+    int nargs = 0;
+    for (int i = 1; i < argc; i++)
     {
-        k = (uint8_t)strtoul(argv[2], NULL, 10);
+        if ((strcmp(argv[i], "-f") == 0) || (strcmp(argv[i], "--format") == 0))
+        {
+            if ((++i >= argc) || ((format = get_format(argv[i])) == FORMAT_INVALID))
+            {
+                usage();
+                return 1;
+            }
+            continue;
+        }
+        if ((strcmp(argv[i], "-q") == 0) || (strcmp(argv[i], "--query") == 0))
+        {
+            if (++i >= argc)
+            {
+                usage();
+                return 1;
+            }
+            qfile = argv[i];
+            continue;
+        }
+        if ((strcmp(argv[i], "-a") == 0) || (strcmp(argv[i], "--all") == 0))
+        {
+            all = true;
+            continue;
+        }
+        if (nargs >= 2)
+        {
+            usage();
+            return 1;
+        }
+        args[nargs++] = argv[i];
     }
-    if ((argc < 2) || (k == 0))
+    if (nargs > 1)
     {
-        fprintf(stderr, "WordFreq %s\n\
-            Find the most frequently used words with their frequency.\n\
-            Usage: wordfreq <INPUT_FILE> [MAX_RESULTS]\n", VERSION);
+        k = (uint8_t)strtoul(args[1], NULL, 10);
+    }
+    // the query list replaces both the k most frequent words and the full list
+    if ((nargs < 1) || (k == 0) || (qfile && (all || (nargs > 1))))
+    {
+        usage();
         return 1;
     }
-    return wordfreq(argv[1], k);
+    if (qfile)
+    {
+        return wordfreq_query(args[0], qfile, format);
+    }
+    return wordfreq(args[0], k, format, all);
 }
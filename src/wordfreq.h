@@ -38,10 +38,12 @@
 #include <string.h>
 #include <stdbool.h>
 #include "mmap.h"
+#include "decomp.h"
+#include "outbuf.h"
 
 #define ALPHABET_SIZE     26  //!< 26 slots each for 'a' to 'z'.
 #define NOCH            0xff  //!< Code used to identify an invalid character.
-#define MAX_WORD_LENGTH  250  //!< Maximum word lenght.
+#define MAX_WORD_LENGTH  250  //!< Size of the high frequency word buffer: longer words are truncated in the top-k output.
 
 /**
  * Returns the character index.
@@ -96,6 +98,7 @@ typedef struct trie_node_t
     bool isend;                               //!< True if the node represent the last character of a word.
     uint8_t  hfidx;                           //!< Position in the hifreq list.
     uint32_t freq;                            //!< Word frequency (number of occurrences).
+    uint32_t cmask;                           //!< Bitmask of the non-NULL child nodes (bit i set for child[i]).
     struct trie_node_t *child[ALPHABET_SIZE]; //!< Pointers to child nodes, one for each alphabet letter.
 } trie_node_t;
 
@@ -114,6 +117,7 @@ static inline trie_node_t *new_trie_node(void)
     node->isend = false;
     node->hfidx = 0;
     node->freq = 0;
+    node->cmask = 0;
     for (uint8_t i = 0; i < ALPHABET_SIZE; i++)
     {
         node->child[i] = NULL;
@@ -122,40 +126,236 @@ static inline trie_node_t *new_trie_node(void)
 }
 
 /**
- * Frees a trie node by node recursively.
+ * Returns the child node for the specified character index, creating it if required.
+ *
+ * @param node Pointer to a trie node.
+ * @param idx  Character index.
+ *
+ * @return Pointer to the child node, or NULL in case of memory allocation error.
+ */
+static inline trie_node_t *get_trie_child(trie_node_t *node, uint8_t idx)
+{
+    if (!node->child[idx])
+    {
+        node->child[idx] = new_trie_node();
+        if (!node->child[idx])
+        {
+            return NULL;
+        }
+        node->cmask |= (1U << idx);
+    }
+    return node->child[idx];
+}
+
+/**
+ * Returns the index of the first child node in the bitmask.
+ *
+ * @param mask Non-zero bitmask of child nodes.
+ *
+ * @return Character index of the first child.
+ */
+static inline uint8_t get_first_child(uint32_t mask)
+{
+#if defined(__GNUC__)
+    return (uint8_t)__builtin_ctz(mask);
+#else
+    uint8_t i = 0;
+    while (!(mask & 1))
+    {
+        mask >>= 1;
+        ++i;
+    }
+    return i;
+#endif
+}
+
+/**
+ * Frees a trie node and all its descendants.
+ * The traversal is iterative and does not allocate memory: the child slots already
+ * visited are reused to store the link back to the parent node.
  *
  * @param node Pointer to a trie node.
  */
 static inline void free_trie_node(trie_node_t *node)
 {
-    for (uint8_t i = 0; i < ALPHABET_SIZE; i++)
+    trie_node_t *parent = NULL;
+    while (node)
+    {
+        if (node->cmask)
+        {
+            // children are visited in ascending order, so child[0] is always free after the first descent
+            uint8_t i = get_first_child(node->cmask);
+            node->cmask &= (node->cmask - 1);
+            trie_node_t *child = node->child[i];
+            node->child[0] = parent;
+            parent = node;
+            node = child;
+            continue;
+        }
+        free(node);
+        node = parent;
+        if (node)
+        {
+            parent = node->child[0];
+        }
+    }
+}
+
+/**
+ * Struct containing the state of a trie iterator.
+ * The words are returned in lexicographic order. The current word is kept in a
+ * single buffer and only the last character is updated at each step.
+ */
+typedef struct trie_iter_t
+{
+    const trie_node_t **node; //!< Stack of the nodes in the current path (node[0] is the root).
+    uint32_t *mask;           //!< Bitmask of the child nodes still to visit for each node in the stack.
+    char *word;               //!< Current word (NULL-terminated).
+    uint64_t depth;           //!< Number of nodes in the stack.
+    uint64_t size;            //!< Allocated stack size.
+    int err;                  //!< Set to 1 in case of memory allocation error.
+} trie_iter_t;
+
+/**
+ * Initialize a trie iterator.
+ *
+ * @param it   Pointer to the iterator.
+ * @param root Root of the trie data structure.
+ *
+ * @return 0 in case of success, 1 in case of memory allocation error.
+ */
+static inline int init_trie_iter(trie_iter_t *it, const trie_node_t *root)
+{
+    it->size = MAX_WORD_LENGTH;
+    it->node = (const trie_node_t **)malloc(it->size * sizeof(trie_node_t *));
+    it->mask = (uint32_t *)malloc(it->size * sizeof(uint32_t));
+    it->word = (char *)malloc(it->size + 1);
+    if (!it->node || !it->mask || !it->word)
+    {
+        free(it->node);
+        free(it->mask);
+        free(it->word);
+        return 1;
+    }
+    it->node[0] = root;
+    it->mask[0] = root->cmask;
+    it->word[0] = 0;
+    it->depth = 1;
+    it->err = 0;
+    return 0;
+}
+
+/**
+ * Free the memory allocated by the trie iterator.
+ *
+ * @param it Pointer to the iterator.
+ */
+static inline void free_trie_iter(trie_iter_t *it)
+{
+    free(it->node);
+    free(it->mask);
+    free(it->word);
+}
+
+/**
+ * Returns the next word in lexicographic order.
+ *
+ * @param it   Pointer to the iterator.
+ * @param freq Returns the word frequency.
+ * @param len  Returns the word length.
+ *
+ * @return Pointer to the NULL-terminated word (valid until the next call),
+ *         or NULL when there are no more words or in case of memory allocation error (err is set).
+ */
+static inline const char *trie_iter_next(trie_iter_t *it, uint32_t *freq, uint64_t *len)
+{
+    while (it->depth > 0)
     {
-        if (node->child[i])
+        uint64_t top = it->depth - 1;
+        uint32_t mask = it->mask[top];
+        if (mask == 0)
+        {
+            --(it->depth);
+            continue;
+        }
+        uint8_t i = get_first_child(mask);
+        it->mask[top] = (mask & (mask - 1));
+        const trie_node_t *child = it->node[top]->child[i];
+        if (it->depth == it->size)
         {
-            free_trie_node(node->child[i]);
+            uint64_t size = it->size * 2;
+            const trie_node_t **node = (const trie_node_t **)realloc((void *)it->node, size * sizeof(trie_node_t *));
+            uint32_t *cmask = (uint32_t *)realloc(it->mask, size * sizeof(uint32_t));
+            char *word = (char *)realloc(it->word, size + 1);
+            it->node = node ? node : it->node;
+            it->mask = cmask ? cmask : it->mask;
+            it->word = word ? word : it->word;
+            if (!node || !cmask || !word)
+            {
+                it->depth = 0;
+                it->err = 1;
+                return NULL;
+            }
+            it->size = size;
+        }
+        it->word[top] = (char)get_index_char(i);
+        it->word[it->depth] = 0;
+        it->node[it->depth] = child;
+        it->mask[it->depth] = child->cmask;
+        ++(it->depth);
+        if (child->isend)
+        {
+            *freq = child->freq;
+            *len = it->depth - 1;
+            return it->word;
         }
     }
-    free(node);
+    return NULL;
 }
 
 /**
  * Struct containing a single hifreq item.
+ * Items with the same frequency are linked together in the list of their frequency bucket.
  */
 typedef struct hifreq_item_t
 {
     trie_node_t *node;          //!< Pointer to trie leaf node.
+    uint8_t bucket;             //!< Position of the frequency bucket containing this item.
+    uint8_t prev;               //!< Position of the previous item in the same bucket (0 = none).
+    uint8_t next;               //!< Position of the next item in the same bucket (0 = none).
     char word[MAX_WORD_LENGTH]; //!< Word.
 } hifreq_item_t;
 
 /**
- * Struct containing the list of high-frequency words (min heap).
- * The maximum frequency word is at position 1.
+ * Struct containing a frequency bucket.
+ * Buckets are linked in ascending frequency order.
+ */
+typedef struct hifreq_bucket_t
+{
+    uint32_t freq;  //!< Frequency shared by all the items in this bucket.
+    uint8_t first;  //!< Position of the first item in this bucket (0 = none).
+    uint8_t prev;   //!< Position of the previous (lower frequency) bucket (0 = none).
+    uint8_t next;   //!< Position of the next (higher frequency) bucket, or next free bucket (0 = none).
+} hifreq_bucket_t;
+
+/**
+ * Struct containing the list of high-frequency words.
+ *
+ * This is a "stream summary" structure designed for increment-only counts:
+ * the items are grouped in a list of frequency buckets sorted in ascending order,
+ * so incrementing a word frequency or replacing the minimum frequency word is O(1).
+ * Position 0 is reserved as "null" value for both items and buckets.
+ * After order_hifreq() the items are sorted in descending frequency order starting at position 1.
  */
 typedef struct hifreq_t
 {
-    uint8_t size;        //!< Max number of words to store.
-    uint8_t count;       //!< Number of slots filled.
-    hifreq_item_t *item; //!< List of nodes + words.
+    uint8_t size;             //!< Max number of words to store.
+    uint8_t count;            //!< Number of slots filled.
+    uint8_t head;             //!< Position of the minimum frequency bucket (0 = none).
+    uint8_t tail;             //!< Position of the maximum frequency bucket (0 = none).
+    uint8_t freebkt;          //!< Position of the first unused bucket (0 = none).
+    hifreq_item_t *item;      //!< List of nodes + words.
+    hifreq_bucket_t *bucket;  //!< List of frequency buckets.
 } hifreq_t;
 
 /**
@@ -168,19 +368,36 @@ typedef struct hifreq_t
 static inline hifreq_t *new_hifreq(uint8_t size)
 {
     hifreq_t *hf = (hifreq_t *)malloc(sizeof(hifreq_t));
+    if (!hf)
+    {
+        return NULL;
+    }
     hf->size = size;
     hf->count = 0;
+    hf->head = 0;
+    hf->tail = 0;
     hf->item = (hifreq_item_t *)malloc(((uint64_t)size + 1) * sizeof(hifreq_item_t));
-    if (!hf->item)
+    hf->bucket = (hifreq_bucket_t *)malloc(((uint64_t)size + 1) * sizeof(hifreq_bucket_t));
+    if (!hf->item || !hf->bucket)
     {
+        free(hf->item);
+        free(hf->bucket);
         free(hf);
         return NULL;
     }
-    for (uint8_t i = 0; i <= size; i++)
+    for (uint16_t i = 0; i <= size; i++)
     {
         hf->item[i].node = NULL;
+        hf->item[i].bucket = 0;
+        hf->item[i].prev = 0;
+        hf->item[i].next = 0;
         hf->item[i].word[0] = 0;
+        hf->bucket[i].freq = 0;
+        hf->bucket[i].first = 0;
+        hf->bucket[i].prev = 0;
+        hf->bucket[i].next = (uint8_t)((i < size) ? (i + 1) : 0);
     }
+    hf->freebkt = (size > 0) ? 1 : 0;
     return hf;
 }
 
@@ -192,11 +409,13 @@ static inline hifreq_t *new_hifreq(uint8_t size)
 static inline void free_hifreq(hifreq_t *hf)
 {
     free(hf->item);
+    free(hf->bucket);
     free(hf);
 }
 
 /**
  * Swap two hifreq items.
+ * NOTE: the bucket links are not updated.
  *
  * @param hf Pointer to hifreq object.
  * @param a Position of the first item.
@@ -211,36 +430,160 @@ static void swap_items(hifreq_t *hf, uint8_t a, uint8_t b)
     hf->item[b] = tmp;
 }
 
+/**
+ * Create a new frequency bucket and link it after the specified one.
+ *
+ * @param hf   Pointer to hifreq object.
+ * @param prev Position of the bucket after which the new one is inserted (0 = insert at head).
+ * @param freq Frequency of the new bucket.
+ *
+ * @return Position of the new bucket.
+ */
+static inline uint8_t insert_bucket(hifreq_t *hf, uint8_t prev, uint32_t freq)
+{
+    uint8_t b = hf->freebkt;
+    hifreq_bucket_t *bkt = &hf->bucket[b];
+    hf->freebkt = bkt->next;
+    bkt->freq = freq;
+    bkt->first = 0;
+    bkt->prev = prev;
+    bkt->next = (prev != 0) ? hf->bucket[prev].next : hf->head;
+    if (bkt->next != 0)
+    {
+        hf->bucket[bkt->next].prev = b;
+    }
+    else
+    {
+        hf->tail = b;
+    }
+    if (prev != 0)
+    {
+        hf->bucket[prev].next = b;
+    }
+    else
+    {
+        hf->head = b;
+    }
+    return b;
+}
+
+/**
+ * Unlink an empty frequency bucket and return it to the free list.
+ *
+ * @param hf Pointer to hifreq object.
+ * @param b  Position of the bucket to remove.
+ */
+static inline void remove_bucket(hifreq_t *hf, uint8_t b)
+{
+    hifreq_bucket_t *bkt = &hf->bucket[b];
+    if (bkt->prev != 0)
+    {
+        hf->bucket[bkt->prev].next = bkt->next;
+    }
+    else
+    {
+        hf->head = bkt->next;
+    }
+    if (bkt->next != 0)
+    {
+        hf->bucket[bkt->next].prev = bkt->prev;
+    }
+    else
+    {
+        hf->tail = bkt->prev;
+    }
+    bkt->next = hf->freebkt;
+    hf->freebkt = b;
+}
 
 /**
- * Heapify the min heap.
+ * Link an item at the beginning of the specified bucket.
  *
  * @param hf  Pointer to hifreq object.
  * @param idx Item position.
+ * @param b   Bucket position.
  */
-static void heapify(hifreq_t *hf, uint8_t idx)
+static inline void link_item(hifreq_t *hf, uint8_t idx, uint8_t b)
 {
-    uint8_t left, right, small;
-    left = (2 * idx);
-    right = (left + 1);
-    small = idx;
-    if ((left <= hf->count) && (hf->item[left].node->freq < hf->item[small].node->freq))
+    hifreq_item_t *it = &hf->item[idx];
+    it->bucket = b;
+    it->prev = 0;
+    it->next = hf->bucket[b].first;
+    if (it->next != 0)
     {
-        small = left;
+        hf->item[it->next].prev = idx;
     }
-    if ((right <= hf->count) && (hf->item[right].node->freq < hf->item[small].node->freq))
+    hf->bucket[b].first = idx;
+}
+
+/**
+ * Unlink an item from its bucket, removing the bucket if it becomes empty.
+ *
+ * @param hf  Pointer to hifreq object.
+ * @param idx Item position.
+ */
+static inline void unlink_item(hifreq_t *hf, uint8_t idx)
+{
+    hifreq_item_t *it = &hf->item[idx];
+    if (it->prev != 0)
     {
-        small = right;
+        hf->item[it->prev].next = it->next;
     }
-    if (small != idx)
+    else
     {
-        swap_items(hf, small, idx);
-        heapify(hf, small);
+        hf->bucket[it->bucket].first = it->next;
+    }
+    if (it->next != 0)
+    {
+        hf->item[it->next].prev = it->prev;
+    }
+    if (hf->bucket[it->bucket].first == 0)
+    {
+        remove_bucket(hf, it->bucket);
     }
 }
 
+/**
+ * Move an item to the bucket matching the current frequency of its node.
+ * The node frequency can only be greater or equal than the current bucket frequency.
+ *
+ * @param hf  Pointer to hifreq object.
+ * @param idx Item position.
+ */
+static inline void promote_item(hifreq_t *hf, uint8_t idx)
+{
+    uint32_t freq = hf->item[idx].node->freq;
+    uint8_t b = hf->item[idx].bucket;
+    uint8_t n = hf->bucket[b].next;
+    bool alone = ((hf->item[idx].prev == 0) && (hf->item[idx].next == 0));
+    if (alone && ((n == 0) || (hf->bucket[n].freq > freq)))
+    {
+        // fast path: the item is alone in its bucket, so just update the bucket frequency
+        hf->bucket[b].freq = freq;
+        return;
+    }
+    if (hf->bucket[b].freq == freq)
+    {
+        return;
+    }
+    // find the last bucket with a frequency not greater than freq (usually b or the next one)
+    uint8_t p = b;
+    while ((n != 0) && (hf->bucket[n].freq <= freq))
+    {
+        p = n;
+        n = hf->bucket[n].next;
+    }
+    unlink_item(hf, idx); // this can only remove b when p != b
+    if (hf->bucket[p].freq != freq)
+    {
+        p = insert_bucket(hf, p, freq);
+    }
+    link_item(hf, idx, p);
+}
+
 /**
  * Update the hifreq list.
+ * This must be called every time the frequency of a trie node is incremented.
  *
  * @param hf   Pointer to hifreq object.
  * @param node Pointer to a trie node.
@@ -251,68 +594,119 @@ static inline void update_hifreq(hifreq_t *hf, trie_node_t *node, const char *wo
     // update existing node (word)
     if (node->hfidx != 0)
     {
-        heapify(hf, node->hfidx);
+        promote_item(hf, node->hfidx);
         return;
     }
-    // add new node (word) - insert sort
+    // add new node (word)
     if (hf->count < hf->size)
     {
-        ++(hf->count);
-        node->hfidx = hf->count;
-        hf->item[hf->count].node = node;
-        memcpy(hf->item[hf->count].word, word, MAX_WORD_LENGTH);
-        for (uint8_t i = (hf->count / 2); i > 0; --i)
+        uint8_t idx = ++(hf->count);
+        node->hfidx = idx;
+        hf->item[idx].node = node;
+        memcpy(hf->item[idx].word, word, MAX_WORD_LENGTH);
+        uint8_t p = 0;
+        uint8_t b = hf->head;
+        while ((b != 0) && (hf->bucket[b].freq <= node->freq))
+        {
+            p = b;
+            b = hf->bucket[b].next;
+        }
+        if ((p == 0) || (hf->bucket[p].freq != node->freq))
         {
-            heapify(hf, i);
+            p = insert_bucket(hf, p, node->freq);
         }
+        link_item(hf, idx, p);
         return;
     }
     // replace min frequency node (word)
-    if (node->freq > hf->item[1].node->freq)
+    if ((hf->head != 0) && (node->freq > hf->bucket[hf->head].freq))
     {
-        hf->item[1].node->hfidx = 0;
-        node->hfidx = 1;
-        hf->item[1].node = node;
-        memcpy(hf->item[1].word, word, MAX_WORD_LENGTH);
-        heapify(hf, node->hfidx);
+        uint8_t idx = hf->bucket[hf->head].first;
+        hf->item[idx].node->hfidx = 0;
+        node->hfidx = idx;
+        hf->item[idx].node = node;
+        memcpy(hf->item[idx].word, word, MAX_WORD_LENGTH);
+        promote_item(hf, idx);
     }
 }
 
 /**
  * Reorder the items in descending order.
+ * The bucket links are no longer valid after this call.
  *
  * @param hf hifreq object.
  */
 static inline void order_hifreq(hifreq_t *hf)
 {
-    uint8_t count = hf->count;
-    while (hf->count > 2)
+    trie_node_t *sorted[256];
+    uint16_t n = 0;
+    for (uint8_t b = hf->tail; b != 0; b = hf->bucket[b].prev)
     {
-        swap_items(hf, 1, hf->count);
-        --(hf->count);
-        heapify(hf, 1);
+        for (uint8_t i = hf->bucket[b].first; i != 0; i = hf->item[i].next)
+        {
+            sorted[++n] = hf->item[i].node;
+        }
     }
-    if (hf->count == 2)
+    for (uint16_t i = 1; i <= hf->count; i++)
     {
-        swap_items(hf, 1, 2);
+        if (sorted[i]->hfidx != i)
+        {
+            swap_items(hf, (uint8_t)i, sorted[i]->hfidx);
+        }
     }
-    hf->count = count;
 }
 
 /**
- * Parse the input file byte-by-byte and update the data structures.
+ * Struct containing the state of the parser, so the input can be parsed in consecutive chunks.
+ * Words crossing the chunk boundaries are preserved.
+ */
+typedef struct parse_state_t
+{
+    trie_node_t *root;          //!< Root of the trie data structure.
+    trie_node_t *node;          //!< Trie node of the current (partial) word.
+    hifreq_t *hf;               //!< Pointer to the hifreq object.
+    uint8_t pos;                //!< Length of the current (partial) word.
+    int err;                    //!< Set to 1 in case of memory allocation error (the rest of the input is ignored).
+    char word[MAX_WORD_LENGTH]; //!< Current (partial) word.
+} parse_state_t;
+
+/**
+ * Initialize the parser state.
  *
- * @param src  Pointer to the memory mapped file data.
- * @param size File size in bytes.
+ * @param st   Pointer to the parser state.
  * @param root Root of the trie data structure.
- * @param mh   Pointer to the hifreq object.
+ * @param hf   Pointer to the hifreq object.
+ */
+static inline void init_parse_state(parse_state_t *st, trie_node_t *root, hifreq_t *hf)
+{
+    st->root = root;
+    st->node = root;
+    st->hf = hf;
+    st->pos = 0;
+    st->err = 0;
+    st->word[0] = 0;
+}
+
+/**
+ * Parse a chunk of input data byte-by-byte and update the data structures.
+ * In case of memory allocation error, st->err is set and the parsing stops.
+ *
+ * @param st   Pointer to the parser state.
+ * @param src  Pointer to the input data.
+ * @param size Input data size in bytes.
  */
-static inline void parse_data(const uint8_t *src, uint64_t size, trie_node_t *root, hifreq_t *hf)
+static inline void parse_chunk(parse_state_t *st, const uint8_t *src, uint64_t size)
 {
     uint8_t idx; // character index
-    trie_node_t *node = root;
-    char word[MAX_WORD_LENGTH] = "";
-    uint8_t pos = 0;
+    if (st->err)
+    {
+        return;
+    }
+    trie_node_t *root = st->root;
+    trie_node_t *node = st->node;
+    hifreq_t *hf = st->hf;
+    char *word = st->word;
+    uint8_t pos = st->pos;
     for (uint64_t i = 0; i < size; i++)
     {
         idx = get_char_index(*src++);
@@ -329,45 +723,152 @@ static inline void parse_data(const uint8_t *src, uint64_t size, trie_node_t *ro
             node = root;
             continue;
         }
-        if (!node->child[idx])
+        trie_node_t *child = get_trie_child(node, idx);
+        if (!child)
         {
-            node->child[idx] = new_trie_node();
+            st->err = 1;
+            break;
         }
-        node = node->child[idx];
+        node = child;
         word[pos] = get_index_char(idx);
         if (pos < (MAX_WORD_LENGTH - 1))
         {
             ++pos;
         }
     }
-    node->isend = true;
-    ++(node->freq);
-    root->isend = false;
-    order_hifreq(hf);
+    st->node = node;
+    st->pos = pos;
+}
+
+/**
+ * Terminate the parsing: count the last word and sort the hifreq list.
+ *
+ * @param st Pointer to the parser state.
+ */
+static inline void parse_finish(parse_state_t *st)
+{
+    if ((st->pos > 0) && !st->err)
+    {
+        st->node->isend = true;
+        ++(st->node->freq);
+        st->word[st->pos] = 0;
+        update_hifreq(st->hf, st->node, st->word);
+        st->pos = 0;
+    }
+    st->node = st->root;
+    order_hifreq(st->hf);
+}
+
+/**
+ * Parse the input file byte-by-byte and update the data structures.
+ *
+ * @param src  Pointer to the memory mapped file data.
+ * @param size File size in bytes.
+ * @param root Root of the trie data structure.
+ * @param hf   Pointer to the hifreq object.
+ *
+ * @return 0 in case of success, 1 in case of memory allocation error.
+ */
+static inline int parse_data(const uint8_t *src, uint64_t size, trie_node_t *root, hifreq_t *hf)
+{
+    parse_state_t st;
+    init_parse_state(&st, root, hf);
+    parse_chunk(&st, src, size);
+    parse_finish(&st);
+    return st.err;
+}
+
+/**
+ * Parse the input data, decompressing it on a separate thread if it is gzip or zstd compressed.
+ *
+ * @param src     Pointer to the memory mapped file data.
+ * @param size    File size in bytes.
+ * @param root    Root of the trie data structure.
+ * @param hf      Pointer to the hifreq object.
+ * @param blksize Size in bytes of the decompressed blocks (0 = DECOMP_BLOCK_SIZE).
+ *
+ * @return Decoder error code (DECOMP_OK on success, DECOMP_NOMEM also if the trie can't be allocated).
+ */
+static inline int parse_input(const uint8_t *src, uint64_t size, trie_node_t *root, hifreq_t *hf, size_t blksize)
+{
+    uint8_t type = get_compression(src, size);
+    if (type == COMP_NONE)
+    {
+        return (parse_data(src, size, root, hf) != 0) ? DECOMP_NOMEM : DECOMP_OK;
+    }
+    decoder_t *dec = new_decoder(src, size, type, blksize);
+    if (!dec)
+    {
+        return DECOMP_NOMEM;
+    }
+    parse_state_t st;
+    init_parse_state(&st, root, hf);
+    const uint8_t *blk;
+    size_t len = 0;
+    // after an allocation error the remaining blocks are still drained, so the decoder can terminate
+    while ((blk = decoder_next(dec, &len)) != NULL)
+    {
+        parse_chunk(&st, blk, len);
+        decoder_release(dec);
+    }
+    parse_finish(&st);
+    int err = free_decoder(dec);
+    return st.err ? DECOMP_NOMEM : err;
 }
 
 /**
  * Print the high frequency words.
  *
  * @param hf hifreq object.
+ * @param ob Output buffer.
+ */
+static inline void print_hifreq(const hifreq_t *hf, outbuf_t *ob)
+{
+    for (uint16_t i = 1; i <= hf->count; i++)
+    {
+        outbuf_record(ob, hf->item[i].node->freq, hf->item[i].word, strlen(hf->item[i].word));
+    }
+}
+
+/**
+ * Print all the words stored in the trie, in alphabetical order.
+ *
+ * @param root Root of the trie data structure.
+ * @param ob   Output buffer.
+ *
+ * @return 0 in case of success, 1 in case of memory allocation error.
  */
-static inline void print_hifreq(hifreq_t *hf)
+static inline int print_trie(const trie_node_t *root, outbuf_t *ob)
 {
-    for (uint8_t i = 1; i <= hf->count; i++)
+    trie_iter_t it;
+    if (init_trie_iter(&it, root) != 0)
+    {
+        return 1;
+    }
+    const char *word;
+    uint32_t freq = 0;
+    uint64_t len = 0;
+    while ((word = trie_iter_next(&it, &freq, &len)) != NULL)
     {
-        fprintf(stdout, "%10" PRIu32 " %s\n", hf->item[i].node->freq, hf->item[i].word);
+        outbuf_record(ob, freq, word, (size_t)len);
     }
+    int err = it.err;
+    free_trie_iter(&it);
+    return err;
 }
 
 /**
  * Parse an input file and print the most frequently used words with their frequency.
+ * The gzip and zstd compressed files are automatically detected and decompressed.
  *
- * @param file File to parse.
- * @param k    Number of words to return.
+ * @param file   File to parse.
+ * @param k      Number of words to return.
+ * @param format Output format (FORMAT_TXT, FORMAT_TSV, FORMAT_CSV, FORMAT_JSON or FORMAT_BIN).
+ * @param all    If true print all the words in alphabetical order instead of the k most frequent ones.
  *
  * @return Error code, 0 in case of success.
  */
-static inline int wordfreq(const char *file, uint8_t k)
+static inline int wordfreq(const char *file, uint8_t k, uint8_t format, bool all)
 {
     // memory-map the input file
     mmfile_t mf = {0,0,0};
@@ -377,14 +878,16 @@ static inline int wordfreq(const char *file, uint8_t k)
         fprintf(stderr, "ERROR: can't open '%s' file.\n", file);
         return 1;
     }
-    if (mf.size == 0)
-    {
-        fprintf(stderr, "ERROR: fstat [%s]\n", strerror(errno));
-        return 2;
-    }
     if (mf.src == MAP_FAILED)
     {
+        if (mf.size == 0)
+        {
+            fprintf(stderr, "ERROR: '%s' is not a regular file.\n", file);
+            close_mmfile(mf);
+            return 2;
+        }
         fprintf(stderr, "ERROR: mmap [%s]\n", strerror(errno));
+        close_mmfile(mf);
         return 3;
     }
 
@@ -392,29 +895,72 @@ static inline int wordfreq(const char *file, uint8_t k)
     if (!root)
     {
         fprintf(stderr, "ERROR: Unable to allocate memory.\n");
+        close_mmfile(mf);
         return 4;
     }
 
     hifreq_t *hf = new_hifreq(k);
-    if (!hf)
+    outbuf_t *ob = new_outbuf(STDOUT_FILENO, format, OUTBUF_SIZE);
+    if (!hf || !ob)
     {
         fprintf(stderr, "ERROR: Unable to allocate memory.\n");
+        if (ob)
+        {
+            free_outbuf(ob);
+        }
+        if (hf)
+        {
+            free_hifreq(hf);
+        }
+        free_trie_node(root);
+        close_mmfile(mf);
         return 5;
     }
 
-    parse_data(mf.src, mf.size, root, hf);
-    print_hifreq(hf);
+    int de = parse_input(mf.src, mf.size, root, hf, DECOMP_BLOCK_SIZE);
+
+    int oe = 0;
+    int te = 0;
+    if (de == DECOMP_OK)
+    {
+        outbuf_begin(ob);
+        if (all)
+        {
+            te = print_trie(root, ob);
+        }
+        else
+        {
+            print_hifreq(hf, ob);
+        }
+        oe = outbuf_end(ob);
+    }
 
+    free_outbuf(ob);
     free_hifreq(hf);
     free_trie_node(root);
 
     // unmap the file
-    int e = munmap_file(mf);
+    int e = close_mmfile(mf);
     if (e != 0)
     {
         fprintf(stderr, "Got %s error while unmapping the %s file\n", strerror(errno), file);
         return 6;
     }
+    if ((de != DECOMP_OK) && (de != DECOMP_NOMEM))
+    {
+        fprintf(stderr, "ERROR: can't decompress '%s' file [%s]\n", file, decomp_strerror(de));
+        return 8;
+    }
+    if ((te != 0) || (de == DECOMP_NOMEM))
+    {
+        fprintf(stderr, "ERROR: Unable to allocate memory.\n");
+        return 5;
+    }
+    if (oe != 0)
+    {
+        fprintf(stderr, "ERROR: write [%s]\n", strerror(oe));
+        return 7;
+    }
     return 0;
 }
 
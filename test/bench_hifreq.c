@@ -0,0 +1,183 @@
+// Nicola Asuni
+//
+// Micro-benchmark for the high-frequency words (top-k) maintenance.
+// The input file is tokenized once in advance, then the sequence of word
+// occurrences is replayed with and without calling update_hifreq(),
+// so the difference measures only the top-k maintenance cost.
+//
+// Usage: bench_hifreq [INPUT_FILE] [MAX_RESULTS] [REPETITIONS]
+
+#if __STDC_VERSION__ >= 199901L
+#define _XOPEN_SOURCE 600
+#else
+#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "../src/wordfreq.h"
+
+/**
+ * Struct containing a pre-tokenized input file.
+ */
+typedef struct tokens_t
+{
+    uint64_t count;      //!< Number of tokens (word occurrences).
+    uint32_t nwords;     //!< Number of distinct words.
+    trie_node_t **node;  //!< Trie leaf node of each token.
+    uint32_t *wid;       //!< Distinct word index of each token.
+    char *words;         //!< Distinct words, MAX_WORD_LENGTH bytes each.
+} tokens_t;
+
+static double get_time_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((double)ts.tv_sec * 1e9) + (double)ts.tv_nsec;
+}
+
+static void reset_tokens(const tokens_t *tk)
+{
+    for (uint64_t i = 0; i < tk->count; i++)
+    {
+        tk->node[i]->freq = 0;
+        tk->node[i]->hfidx = 0;
+    }
+}
+
+// Tokenize the input data, using the node frequency field to temporarily store the distinct word index.
+static int tokenize(const uint8_t *src, uint64_t size, trie_node_t *root, tokens_t *tk)
+{
+    tk->count = 0;
+    tk->nwords = 0;
+    tk->node = (trie_node_t **)malloc((size / 2 + 1) * sizeof(trie_node_t *));
+    tk->wid = (uint32_t *)malloc((size / 2 + 1) * sizeof(uint32_t));
+    tk->words = NULL;
+    if (!tk->node || !tk->wid)
+    {
+        return 1;
+    }
+    trie_node_t *node = root;
+    char word[MAX_WORD_LENGTH] = "";
+    uint8_t pos = 0;
+    for (uint64_t i = 0; i <= size; i++)
+    {
+        uint8_t idx = (i < size) ? get_char_index(src[i]) : NOCH;
+        if (idx == NOCH)
+        {
+            if (pos > 0)
+            {
+                word[pos] = 0;
+                if (node->freq == 0)
+                {
+                    char *w = (char *)realloc(tk->words, ((uint64_t)tk->nwords + 1) * MAX_WORD_LENGTH);
+                    if (!w)
+                    {
+                        return 1;
+                    }
+                    tk->words = w;
+                    memcpy(tk->words + ((uint64_t)tk->nwords * MAX_WORD_LENGTH), word, MAX_WORD_LENGTH);
+                    node->freq = ++(tk->nwords);
+                }
+                tk->node[tk->count] = node;
+                tk->wid[tk->count] = node->freq - 1;
+                ++(tk->count);
+                pos = 0;
+            }
+            node = root;
+            continue;
+        }
+        node = get_trie_child(node, idx);
+        if (!node)
+        {
+            return 1;
+        }
+        word[pos] = get_index_char(idx);
+        if (pos < (MAX_WORD_LENGTH - 1))
+        {
+            ++pos;
+        }
+    }
+    return 0;
+}
+
+// Replay all the tokens and return the elapsed time in nanoseconds.
+static double replay(const tokens_t *tk, uint8_t k, bool update, uint32_t *top)
+{
+    reset_tokens(tk);
+    hifreq_t *hf = new_hifreq(k);
+    if (!hf)
+    {
+        return -1;
+    }
+    double start = get_time_ns();
+    for (uint64_t i = 0; i < tk->count; i++)
+    {
+        trie_node_t *node = tk->node[i];
+        ++(node->freq);
+        if (update)
+        {
+            update_hifreq(hf, node, tk->words + ((uint64_t)tk->wid[i] * MAX_WORD_LENGTH));
+        }
+    }
+    order_hifreq(hf);
+    double elapsed = get_time_ns() - start;
+    *top = (hf->count > 0) ? hf->item[1].node->freq : 0;
+    free_hifreq(hf);
+    return elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *file = (argc > 1) ? argv[1] : "mobydick.txt";
+    uint8_t k = (argc > 2) ? (uint8_t)strtoul(argv[2], NULL, 10) : 20;
+    uint32_t reps = (argc > 3) ? (uint32_t)strtoul(argv[3], NULL, 10) : 50;
+    if (reps == 0)
+    {
+        reps = 1;
+    }
+
+    mmfile_t mf = {0,0,0};
+    mmap_file(file, &mf);
+    if ((mf.fd < 0) || (mf.size == 0) || (mf.src == MAP_FAILED))
+    {
+        fprintf(stderr, "ERROR: can't map '%s' file.\n", file);
+        return 1;
+    }
+    trie_node_t *root = new_trie_node();
+    tokens_t tk;
+    if (!root || (tokenize(mf.src, mf.size, root, &tk) != 0))
+    {
+        fprintf(stderr, "ERROR: Unable to allocate memory.\n");
+        return 1;
+    }
+
+    // keep the best time of each replay to filter out the system noise
+    double base = -1;
+    double full = -1;
+    uint32_t top = 0;
+    for (uint32_t r = 0; r < reps; r++)
+    {
+        double t = replay(&tk, k, false, &top);
+        if ((base < 0) || (t < base))
+        {
+            base = t;
+        }
+        t = replay(&tk, k, true, &top);
+        if ((full < 0) || (t < full))
+        {
+            full = t;
+        }
+    }
+    double tokens = (double)tk.count;
+    fprintf(stdout, "file: %s, tokens: %" PRIu64 ", distinct words: %" PRIu32 ", k: %" PRIu8 ", repetitions: %" PRIu32 "\n", file, tk.count, tk.nwords, k, reps);
+    fprintf(stdout, "top-k maintenance: %.2f ns/token (max frequency: %" PRIu32 ")\n", (full - base) / tokens, top);
+
+    free(tk.node);
+    free(tk.wid);
+    free(tk.words);
+    free_trie_node(root);
+    munmap_file(mf);
+    return 0;
+}
@@ -0,0 +1,76 @@
+// Nicola Asuni
+
+// Fuzz target for parse_data() and parse_chunk().
+// The results are compared with the simple reference counter in refcount.h.
+//
+// With -DBUILD_FUZZER=ON (Clang only) this is linked with libFuzzer, ASan and UBSan.
+// Otherwise a main() function is provided to replay the files passed as arguments.
+
+#if __STDC_VERSION__ >= 199901L
+#define _XOPEN_SOURCE 600
+#else
+#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include "refcount.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    refcount_t *rc = new_refcount(data, size);
+    trie_node_t *root1 = new_trie_node();
+    trie_node_t *root2 = new_trie_node();
+    // the first byte selects the number of high frequency words and the chunk size
+    uint8_t k = (size > 0) ? data[0] : 1;
+    uint64_t chunk = (size > 0) ? (1 + (data[0] % 17)) : 1;
+    hifreq_t *hf1 = new_hifreq((k > 0) ? k : 1);
+    hifreq_t *hf2 = new_hifreq(10);
+    if (!rc || !root1 || !root2 || !hf1 || !hf2)
+    {
+        abort();
+    }
+    parse_data(data, size, root1, hf1);
+    parse_state_t st;
+    init_parse_state(&st, root2, hf2);
+    for (uint64_t pos = 0; pos < size; pos += chunk)
+    {
+        parse_chunk(&st, data + pos, ((size - pos) < chunk) ? (size - pos) : chunk);
+    }
+    parse_finish(&st);
+    int errors = check_refcount_trie(rc, root1, "parse_data");
+    errors += check_refcount_hifreq(rc, hf1, "parse_data");
+    errors += check_refcount_trie(rc, root2, "parse_chunk");
+    errors += check_refcount_hifreq(rc, hf2, "parse_chunk");
+    if (errors > 0)
+    {
+        abort();
+    }
+    free_hifreq(hf1);
+    free_hifreq(hf2);
+    free_trie_node(root1);
+    free_trie_node(root2);
+    free_refcount(rc);
+    return 0;
+}
+
+#ifndef WORDFREQ_LIBFUZZER
+int main(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        mmfile_t mf = {0,0,0};
+        mmap_file(argv[i], &mf);
+        if ((mf.fd < 0) || (mf.src == MAP_FAILED))
+        {
+            fprintf(stderr, "ERROR: can't map '%s' file.\n", argv[i]);
+            return 1;
+        }
+        LLVMFuzzerTestOneInput(mf.src, (size_t)mf.size);
+        close_mmfile(mf);
+    }
+    return 0;
+}
+#endif
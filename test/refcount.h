@@ -0,0 +1,237 @@
+// Nicola Asuni
+
+/**
+ * @file refcount.h
+ * @brief Simple reference word counter used to cross-check the wordfreq engines.
+ *
+ * The words are extracted with the same rules of the parser (runs of ASCII letters, case insensitive),
+ * copied in lowercase, sorted with qsort() and counted in runs.
+ * It is slow and memory hungry, but it is simple enough to be obviously correct.
+ */
+
+#ifndef WORDFREQ_REFCOUNT_H
+#define WORDFREQ_REFCOUNT_H
+
+#include <stdio.h>
+#include <string.h>
+#include "../src/query.h"
+
+/**
+ * Struct containing the list of distinct words sorted in lexicographic order, with their frequency.
+ */
+typedef struct refcount_t
+{
+    char *text;     //!< Lowercase copy of the input where each word is NUL-terminated.
+    char **word;    //!< Distinct words in lexicographic order.
+    uint64_t *len;  //!< Length of each distinct word.
+    uint32_t *freq; //!< Frequency of each distinct word.
+    uint64_t nwords;  //!< Number of distinct words.
+    uint64_t total;   //!< Total number of words.
+    uint64_t maxlen;  //!< Length of the longest word.
+} refcount_t;
+
+static int refcount_cmp(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int refcount_freq_cmp(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x < y) - (x > y); // descending order
+}
+
+/**
+ * Free the memory allocated by new_refcount().
+ *
+ * @param rc Pointer to the reference counter.
+ */
+static inline void free_refcount(refcount_t *rc)
+{
+    if (rc)
+    {
+        free(rc->text);
+        free(rc->word);
+        free(rc->len);
+        free(rc->freq);
+        free(rc);
+    }
+}
+
+/**
+ * Count the words in the input data.
+ *
+ * @param src  Pointer to the input data.
+ * @param size Input data size in bytes.
+ *
+ * @return Pointer to the new reference counter, or NULL in case of memory allocation error.
+ */
+static inline refcount_t *new_refcount(const uint8_t *src, uint64_t size)
+{
+    refcount_t *rc = (refcount_t *)calloc(1, sizeof(refcount_t));
+    if (!rc)
+    {
+        return NULL;
+    }
+    uint64_t maxwords = (size / 2) + 1; // each word is followed by a separator
+    rc->text = (char *)malloc(size + 1);
+    rc->word = (char **)malloc(maxwords * sizeof(char *));
+    rc->len = (uint64_t *)malloc(maxwords * sizeof(uint64_t));
+    rc->freq = (uint32_t *)malloc(maxwords * sizeof(uint32_t));
+    if (!rc->text || !rc->word || !rc->len || !rc->freq)
+    {
+        free_refcount(rc);
+        return NULL;
+    }
+    uint64_t start = 0;
+    for (uint64_t i = 0; i <= size; i++)
+    {
+        uint8_t c = (i < size) ? src[i] : 0;
+        if (((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')))
+        {
+            rc->text[i] = (char)(c | 0x20);
+            continue;
+        }
+        rc->text[i] = 0;
+        if (i > start)
+        {
+            rc->word[rc->total++] = rc->text + start;
+        }
+        start = i + 1;
+    }
+    qsort(rc->word, rc->total, sizeof(char *), refcount_cmp);
+    for (uint64_t i = 0; i < rc->total; i++)
+    {
+        if ((rc->nwords > 0) && (strcmp(rc->word[rc->nwords - 1], rc->word[i]) == 0))
+        {
+            ++(rc->freq[rc->nwords - 1]);
+            continue;
+        }
+        rc->word[rc->nwords] = rc->word[i];
+        rc->len[rc->nwords] = strlen(rc->word[i]);
+        rc->freq[rc->nwords] = 1;
+        rc->maxlen = (rc->len[rc->nwords] > rc->maxlen) ? rc->len[rc->nwords] : rc->maxlen;
+        ++(rc->nwords);
+    }
+    return rc;
+}
+
+/**
+ * Returns the frequency of a word (0 if the word is not present).
+ *
+ * @param rc   Pointer to the reference counter.
+ * @param word Lowercase NUL-terminated word.
+ *
+ * @return Word frequency.
+ */
+static inline uint32_t get_refcount_freq(const refcount_t *rc, const char *word)
+{
+    char **w = (char **)bsearch(&word, rc->word, rc->nwords, sizeof(char *), refcount_cmp);
+    return w ? rc->freq[w - rc->word] : 0;
+}
+
+/**
+ * Returns a newly allocated copy of the frequencies sorted in descending order.
+ *
+ * @param rc Pointer to the reference counter.
+ *
+ * @return Sorted frequencies, or NULL in case of memory allocation error.
+ */
+static inline uint32_t *get_refcount_sorted_freq(const refcount_t *rc)
+{
+    uint32_t *freq = (uint32_t *)malloc((rc->nwords + 1) * sizeof(uint32_t));
+    if (freq)
+    {
+        memcpy(freq, rc->freq, rc->nwords * sizeof(uint32_t));
+        qsort(freq, rc->nwords, sizeof(uint32_t), refcount_freq_cmp);
+    }
+    return freq;
+}
+
+/**
+ * Compare the whole trie with the reference counter, using the trie iterator.
+ *
+ * @param rc   Pointer to the reference counter.
+ * @param root Root of the trie data structure.
+ * @param name Name of the test case (for error messages).
+ *
+ * @return Number of errors.
+ */
+static inline int check_refcount_trie(const refcount_t *rc, const trie_node_t *root, const char *name)
+{
+    trie_iter_t it;
+    if (init_trie_iter(&it, root) != 0)
+    {
+        fprintf(stderr, "%s ERROR: Unable to allocate memory.\n", __func__);
+        return 1;
+    }
+    int errors = 0;
+    uint64_t i = 0;
+    const char *word;
+    uint32_t freq = 0;
+    uint64_t len = 0;
+    // the trie is visited in lexicographic order, like the sorted reference list
+    while (((word = trie_iter_next(&it, &freq, &len)) != NULL) && (errors < 10))
+    {
+        if ((i >= rc->nwords) || (len != rc->len[i]) || (freq != rc->freq[i]) || (memcmp(word, rc->word[i], len) != 0))
+        {
+            fprintf(stderr, "%s ERROR: %s: unexpected word (%" PRIu64 ") '%.40s' (%" PRIu32 ")\n", __func__, name, i, word, freq);
+            ++errors;
+        }
+        ++i;
+    }
+    if (it.err || ((errors == 0) && (i != rc->nwords)))
+    {
+        fprintf(stderr, "%s ERROR: %s: expected %" PRIu64 " distinct words, got %" PRIu64 "\n", __func__, name, rc->nwords, i);
+        ++errors;
+    }
+    free_trie_iter(&it);
+    return errors;
+}
+
+/**
+ * Compare the high frequency words with the reference counter.
+ * Ties can be resolved in any order, so only the frequencies are compared by rank.
+ *
+ * @param rc   Pointer to the reference counter.
+ * @param hf   Pointer to the ordered hifreq object.
+ * @param name Name of the test case (for error messages).
+ *
+ * @return Number of errors.
+ */
+static inline int check_refcount_hifreq(const refcount_t *rc, const hifreq_t *hf, const char *name)
+{
+    uint32_t *freq = get_refcount_sorted_freq(rc);
+    if (!freq)
+    {
+        fprintf(stderr, "%s ERROR: Unable to allocate memory.\n", __func__);
+        return 1;
+    }
+    int errors = 0;
+    uint64_t count = (rc->nwords < hf->size) ? rc->nwords : hf->size;
+    if (hf->count != count)
+    {
+        fprintf(stderr, "%s ERROR: %s: expected %" PRIu64 " high frequency words, got %" PRIu8 "\n", __func__, name, count, hf->count);
+        ++errors;
+    }
+    for (uint16_t i = 1; (i <= hf->count) && (i <= count); i++)
+    {
+        const hifreq_item_t *item = &hf->item[i];
+        if (item->node->freq != freq[i - 1])
+        {
+            fprintf(stderr, "%s ERROR: %s: expected frequency %" PRIu32 " at rank %" PRIu16 ", got %" PRIu32 "\n", __func__, name, freq[i - 1], i, item->node->freq);
+            ++errors;
+        }
+        // longer words are truncated in the hifreq list
+        if ((strlen(item->word) < (MAX_WORD_LENGTH - 1)) && (get_refcount_freq(rc, item->word) != item->node->freq))
+        {
+            fprintf(stderr, "%s ERROR: %s: unexpected word at rank %" PRIu16 ": '%s' (%" PRIu32 ")\n", __func__, name, i, item->word, item->node->freq);
+            ++errors;
+        }
+    }
+    free(freq);
+    return errors;
+}
+
+#endif  // WORDFREQ_REFCOUNT_H
@@ -0,0 +1,364 @@
+// Nicola Asuni
+
+#if __STDC_VERSION__ >= 199901L
+#define _XOPEN_SOURCE 600
+#else
+#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Sleep at once instead of spinning first, so the threads often race on the wake-up path
+// (with a shared waiting flag, test_ring_sleep() hangs almost every run).
+#define DECOMP_SPIN 0
+#include "../src/wordfreq.h"
+#include "testutil.h"
+
+#define RING_TEST_ROUND  32                       //!< Number of blocks in each round of test_ring_sleep().
+#define RING_TEST_BLOCKS (2000 * RING_TEST_ROUND)  //!< Number of blocks exchanged by test_ring_sleep().
+#define RING_TEST_PAUSE  300                       //!< Pause in microseconds, much longer than the DECOMP_SPIN phase.
+
+int test_get_compression()
+{
+    int errors = 0;
+    const uint8_t gz[] = {0x1f, 0x8b, 0x08};
+    const uint8_t zst[] = {0x28, 0xb5, 0x2f, 0xfd};
+    const uint8_t txt[] = "text";
+    if (get_compression(gz, sizeof(gz)) != COMP_GZIP)
+    {
+        fprintf(stderr, "%s ERROR: gzip format expected\n", __func__);
+        ++errors;
+    }
+    if (get_compression(zst, sizeof(zst)) != COMP_ZSTD)
+    {
+        fprintf(stderr, "%s ERROR: zstd format expected\n", __func__);
+        ++errors;
+    }
+    if ((get_compression(txt, 4) != COMP_NONE) || (get_compression(zst, 3) != COMP_NONE) || (get_compression(gz, 0) != COMP_NONE))
+    {
+        fprintf(stderr, "%s ERROR: no compression expected\n", __func__);
+        ++errors;
+    }
+    return errors;
+}
+
+// Decode the data and compare the result with the expected one.
+int test_decoder(const uint8_t *src, uint64_t size, uint8_t type, size_t blksize, const uint8_t *expected, uint64_t explen, int experr)
+{
+    decoder_t *dec = new_decoder(src, size, type, blksize);
+    if (!dec)
+    {
+        fprintf(stderr, "%s ERROR: Unable to create the decoder.\n", __func__);
+        return 1;
+    }
+    int errors = 0;
+    uint64_t pos = 0;
+    const uint8_t *blk;
+    size_t len = 0;
+    while ((blk = decoder_next(dec, &len)) != NULL)
+    {
+        if ((len > blksize) || ((pos + len) > explen) || (memcmp(blk, expected + pos, len) != 0))
+        {
+            ++errors;
+        }
+        pos += len;
+        decoder_release(dec);
+    }
+    int e = free_decoder(dec);
+    if (e != experr)
+    {
+        fprintf(stderr, "%s ERROR: expected decoder error %d, got %d (%s)\n", __func__, experr, e, decomp_strerror(e));
+        ++errors;
+    }
+    if ((experr == DECOMP_OK) && ((errors > 0) || (pos != explen)))
+    {
+        fprintf(stderr, "%s ERROR: unexpected decompressed data (type %" PRIu8 ", block size %zu)\n", __func__, type, blksize);
+        ++errors;
+    }
+    return errors;
+}
+
+// Compare the results of parse_input() on compressed data with parse_data() on plain data.
+int test_parse_input(const uint8_t *src, uint64_t size, const uint8_t *plain, uint64_t plainsize, size_t blksize, uint8_t k)
+{
+    trie_node_t *root1 = new_trie_node();
+    trie_node_t *root2 = new_trie_node();
+    hifreq_t *hf1 = new_hifreq(k);
+    hifreq_t *hf2 = new_hifreq(k);
+    if (!root1 || !root2 || !hf1 || !hf2)
+    {
+        fprintf(stderr, "%s ERROR: Unable to allocate memory.\n", __func__);
+        return 1;
+    }
+    int errors = 0;
+    parse_data(plain, plainsize, root1, hf1);
+    int e = parse_input(src, size, root2, hf2, blksize);
+    if (e != DECOMP_OK)
+    {
+        fprintf(stderr, "%s ERROR: decoder error: %s\n", __func__, decomp_strerror(e));
+        ++errors;
+    }
+    else if (hf1->count != hf2->count)
+    {
+        fprintf(stderr, "%s ERROR: expected (%" PRIu8 ") results, got %" PRIu8 "\n", __func__, hf1->count, hf2->count);
+        ++errors;
+    }
+    else
+    {
+        for (uint16_t i = 1; i <= hf1->count; i++)
+        {
+            if (hf1->item[i].node->freq != hf2->item[i].node->freq)
+            {
+                fprintf(stderr, "%s ERROR: different frequency for (%" PRIu16 "): %" PRIu32 " != %" PRIu32 ".\n", __func__, i, hf1->item[i].node->freq, hf2->item[i].node->freq);
+                ++errors;
+            }
+        }
+    }
+    free_hifreq(hf1);
+    free_hifreq(hf2);
+    free_trie_node(root1);
+    free_trie_node(root2);
+    return errors;
+}
+
+int test_compressed(const uint8_t *plain, uint64_t plainsize, uint8_t type)
+{
+    uint64_t size = 0;
+    uint8_t *src = compress_data(plain, plainsize, type, &size);
+    if (!src || (size == 0))
+    {
+        fprintf(stderr, "%s ERROR: unable to compress the data (type %" PRIu8 ")\n", __func__, type);
+        free(src);
+        return 1;
+    }
+    int errors = 0;
+    size_t blksizes[] = {1, 7, 4096, DECOMP_BLOCK_SIZE};
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        errors += test_decoder(src, size, type, blksizes[i], plain, plainsize, DECOMP_OK);
+    }
+    errors += test_parse_input(src, size, plain, plainsize, 7, 100);
+    errors += test_parse_input(src, size, plain, plainsize, DECOMP_BLOCK_SIZE, 100);
+    // truncated data
+    errors += test_decoder(src, size / 2, type, 4096, plain, plainsize, DECOMP_CORRUPTED);
+    // concatenated members/frames
+    uint8_t *src2 = (uint8_t *)malloc(size * 2);
+    uint8_t *plain2 = (uint8_t *)malloc(plainsize * 2);
+    if (src2 && plain2)
+    {
+        memcpy(src2, src, size);
+        memcpy(src2 + size, src, size);
+        memcpy(plain2, plain, plainsize);
+        memcpy(plain2 + plainsize, plain, plainsize);
+        errors += test_decoder(src2, size * 2, type, 4096, plain2, plainsize * 2, DECOMP_OK);
+    }
+    free(src2);
+    free(plain2);
+    free(src);
+    return errors;
+}
+
+int test_gzip_padding(const uint8_t *plain, uint64_t plainsize)
+{
+    uint64_t size = 0;
+    uint8_t *src = compress_data(plain, plainsize, COMP_GZIP, &size);
+    uint8_t *src2 = (uint8_t *)calloc(size + 1000, 1);
+    if (!src || (size == 0) || !src2)
+    {
+        fprintf(stderr, "%s ERROR: unable to compress the data\n", __func__);
+        free(src);
+        free(src2);
+        return 1;
+    }
+    int errors = 0;
+    memcpy(src2, src, size);
+    // trailing zero bytes are ignored, like gzip does
+    errors += test_decoder(src2, size + 1000, COMP_GZIP, 4096, plain, plainsize, DECOMP_OK);
+    errors += test_decoder(src2, size + 1000, COMP_GZIP, 7, plain, plainsize, DECOMP_OK);
+    // any other trailing data is invalid
+    src2[size + 500] = 1;
+    errors += test_decoder(src2, size + 1000, COMP_GZIP, 4096, plain, plainsize, DECOMP_CORRUPTED);
+    free(src2);
+    free(src);
+    return errors;
+}
+
+// Consume the blocks slowly: the decoder thread must sleep instead of spinning while the ring is full.
+int test_decoder_sleep(const uint8_t *src, uint64_t size, uint8_t type)
+{
+    decoder_t *dec = new_decoder(src, size, type, 4096);
+    if (!dec)
+    {
+        fprintf(stderr, "%s ERROR: Unable to create the decoder.\n", __func__);
+        return 1;
+    }
+    struct timespec pause = {0, 5000000};
+    clock_t start = clock();
+    const uint8_t *blk;
+    size_t len = 0;
+    for (int i = 0; (i < 40) && ((blk = decoder_next(dec, &len)) != NULL); i++)
+    {
+        nanosleep(&pause, NULL);
+        decoder_release(dec);
+    }
+    double cpu = (double)(clock() - start) / CLOCKS_PER_SEC;
+    while ((blk = decoder_next(dec, &len)) != NULL)
+    {
+        decoder_release(dec);
+    }
+    int errors = 0;
+    if (free_decoder(dec) != DECOMP_OK)
+    {
+        fprintf(stderr, "%s ERROR: unexpected decoder error\n", __func__);
+        ++errors;
+    }
+    // 40 pauses of 5 ms: a spinning thread would use about 200 ms of CPU time
+    if (cpu > 0.1)
+    {
+        fprintf(stderr, "%s ERROR: the decoder thread is busy waiting (%f s of CPU time)\n", __func__, cpu);
+        ++errors;
+    }
+    return errors;
+}
+
+// Returns the elapsed time in microseconds.
+static uint64_t elapsed_us(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)((now.tv_sec - start->tv_sec) * 1000000L + ((now.tv_nsec - start->tv_nsec) / 1000L));
+}
+
+// Producer of test_ring_sleep(): publish the block numbers, pausing at the start of the even rounds.
+static void *ring_test_producer(void *arg)
+{
+    decoder_t *dec = (decoder_t *)arg;
+    struct timespec pause = {0, RING_TEST_PAUSE * 1000};
+    uint32_t sleeps = 0;
+    for (uint32_t i = 0; i < RING_TEST_BLOCKS; i++)
+    {
+        if ((i % (2 * RING_TEST_ROUND)) == 0)
+        {
+            nanosleep(&pause, NULL); // the consumer drains the ring and sleeps
+        }
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        uint8_t *blk = ring_reserve(dec);
+        sleeps += (elapsed_us(&start) >= (RING_TEST_PAUSE / 2));
+        memcpy(blk, &i, sizeof(i));
+        ring_publish(dec, sizeof(i));
+    }
+    dec->err = (sleeps > 0) ? DECOMP_OK : DECOMP_CORRUPTED;
+    __atomic_store_n(&dec->done, 1, __ATOMIC_SEQ_CST);
+    ring_wake(dec, RING_CONSUMER);
+    return NULL;
+}
+
+// The threads pause in alternate rounds, so both sides of the ring sleep many times,
+// and a thread often goes to sleep while the other one is waking up.
+// A lost wake-up hangs the test, and the alarm terminates it.
+int test_ring_sleep()
+{
+    decoder_t *dec = (decoder_t *)calloc(1, sizeof(decoder_t));
+    if (!dec)
+    {
+        fprintf(stderr, "%s ERROR: Unable to allocate memory.\n", __func__);
+        return 1;
+    }
+    dec->blksize = sizeof(uint32_t);
+    dec->data = (uint8_t *)malloc(dec->blksize * DECOMP_RING_SIZE);
+    pthread_mutex_init(&dec->mutex, NULL);
+    pthread_cond_init(&dec->cond[RING_CONSUMER], NULL);
+    pthread_cond_init(&dec->cond[RING_PRODUCER], NULL);
+    if (!dec->data || (pthread_create(&dec->thread, NULL, ring_test_producer, dec) != 0))
+    {
+        fprintf(stderr, "%s ERROR: Unable to start the producer.\n", __func__);
+        return 1;
+    }
+    alarm(60);
+    int errors = 0;
+    struct timespec pause = {0, RING_TEST_PAUSE * 1000};
+    uint32_t sleeps = 0;
+    uint32_t count = 0;
+    for (;;)
+    {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        size_t len = 0;
+        const uint8_t *blk = decoder_next(dec, &len);
+        if (!blk)
+        {
+            break;
+        }
+        sleeps += (elapsed_us(&start) >= (RING_TEST_PAUSE / 2));
+        uint32_t n = 0;
+        memcpy(&n, blk, sizeof(n));
+        decoder_release(dec);
+        if ((len != sizeof(n)) || (n != count))
+        {
+            ++errors;
+        }
+        if ((count % (2 * RING_TEST_ROUND)) == RING_TEST_ROUND)
+        {
+            nanosleep(&pause, NULL); // the producer fills the ring and sleeps
+        }
+        ++count;
+    }
+    alarm(0);
+    if ((free_decoder(dec) != DECOMP_OK) || (sleeps == 0))
+    {
+        fprintf(stderr, "%s ERROR: both sides were expected to sleep (consumer: %" PRIu32 ")\n", __func__, sleeps);
+        ++errors;
+    }
+    if (count != RING_TEST_BLOCKS)
+    {
+        fprintf(stderr, "%s ERROR: expected %d blocks, got %" PRIu32 "\n", __func__, RING_TEST_BLOCKS, count);
+        ++errors;
+    }
+    return errors;
+}
+
+int main()
+{
+    int errors = 0;
+
+    errors += test_get_compression();
+    errors += test_ring_sleep();
+
+    mmfile_t mf = {0,0,0};
+    mmap_file("mobydick.txt", &mf);
+    if ((mf.fd < 0) || (mf.size == 0) || (mf.src == MAP_FAILED))
+    {
+        fprintf(stderr, "ERROR: can't map 'mobydick.txt' file.\n");
+        return 1;
+    }
+
+#ifdef HAVE_ZLIB
+    errors += test_compressed(mf.src, mf.size, COMP_GZIP);
+    errors += test_gzip_padding(mf.src, mf.size);
+    uint64_t gzsize = 0;
+    uint8_t *gz = compress_data(mf.src, mf.size, COMP_GZIP, &gzsize);
+    if (gz)
+    {
+        errors += test_decoder_sleep(gz, gzsize, COMP_GZIP);
+    }
+    free(gz);
+#else
+    const uint8_t gz[] = {0x1f, 0x8b, 0x08, 0x00};
+    errors += test_decoder(gz, sizeof(gz), COMP_GZIP, 4096, gz, 0, DECOMP_UNSUPPORTED);
+#endif
+
+#ifdef HAVE_ZSTD
+    errors += test_compressed(mf.src, mf.size, COMP_ZSTD);
+#else
+    const uint8_t zst[] = {0x28, 0xb5, 0x2f, 0xfd, 0x00};
+    errors += test_decoder(zst, sizeof(zst), COMP_ZSTD, 4096, zst, 0, DECOMP_UNSUPPORTED);
+#endif
+
+    munmap_file(mf);
+
+    return errors;
+}
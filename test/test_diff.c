@@ -0,0 +1,290 @@
+// Nicola Asuni
+
+// Differential tests: random and adversarial inputs are counted by every engine
+// and the results are compared with the simple reference counter in refcount.h.
+
+#if __STDC_VERSION__ >= 199901L
+#define _XOPEN_SOURCE 600
+#else
+#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "refcount.h"
+#include "testutil.h"
+
+#define DIFF_SEED 0x9e3779b97f4a7c15ULL //!< Fixed seed, so any failure can be reproduced.
+
+// xorshift64 pseudo-random number generator
+static uint64_t rnd(uint64_t *s)
+{
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+// Parse the data in chunks of the specified size (0 = random sizes) and compare the results.
+int test_diff_chunk(const refcount_t *rc, const uint8_t *src, uint64_t size, uint64_t chunk, uint8_t k, const char *name)
+{
+    trie_node_t *root = new_trie_node();
+    hifreq_t *hf = new_hifreq(k);
+    if (!root || !hf)
+    {
+        fprintf(stderr, "%s ERROR: Unable to allocate memory.\n", __func__);
+        return 1;
+    }
+    uint64_t seed = DIFF_SEED + chunk + size;
+    parse_state_t st;
+    init_parse_state(&st, root, hf);
+    for (uint64_t pos = 0, len = 0; pos < size; pos += len)
+    {
+        len = (chunk > 0) ? chunk : (1 + (rnd(&seed) % 300));
+        len = ((size - pos) < len) ? (size - pos) : len;
+        parse_chunk(&st, src + pos, len);
+    }
+    parse_finish(&st);
+    int errors = check_refcount_trie(rc, root, name);
+    errors += check_refcount_hifreq(rc, hf, name);
+    if (errors > 0)
+    {
+        fprintf(stderr, "%s ERROR: %s: chunk size %" PRIu64 ", k %" PRIu8 "\n", __func__, name, chunk, k);
+    }
+    free_hifreq(hf);
+    free_trie_node(root);
+    return errors;
+}
+
+// Count all the input words and some missing words with the query engine.
+int test_diff_query(const refcount_t *rc, const uint8_t *src, uint64_t size, uint64_t chunk, const char *name)
+{
+    const char *missing = " zzzzzq qqqqqx ";
+    uint8_t *list = (uint8_t *)malloc(size + strlen(missing));
+    if (!list)
+    {
+        fprintf(stderr, "%s ERROR: Unable to allocate memory.\n", __func__);
+        return 1;
+    }
+    memcpy(list, missing, strlen(missing));
+    if (size > 0)
+    {
+        memcpy(list + strlen(missing), src, size);
+    }
+    query_t *q = new_query(list, size + strlen(missing));
+    free(list);
+    if (!q)
+    {
+        fprintf(stderr, "%s ERROR: Unable to allocate memory.\n", __func__);
+        return 1;
+    }
+    uint32_t state = QUERY_ROOT;
+    for (uint64_t pos = 0; pos < size; pos += chunk)
+    {
+        query_chunk(q, &state, src + pos, ((size - pos) < chunk) ? (size - pos) : chunk);
+    }
+    query_finish(q, &state);
+    int errors = 0;
+    if (q->nwords != (rc->nwords + 2 - (get_refcount_freq(rc, "zzzzzq") > 0) - (get_refcount_freq(rc, "qqqqqx") > 0)))
+    {
+        fprintf(stderr, "%s ERROR: %s: unexpected number of query words: %" PRIu32 "\n", __func__, name, q->nwords);
+        ++errors;
+    }
+    for (uint32_t i = 1; (i <= q->nwords) && (errors < 10); i++)
+    {
+        uint64_t len = q->woff[i + 1] - q->woff[i];
+        char *word = (char *)malloc(len + 1);
+        if (!word)
+        {
+            ++errors;
+            break;
+        }
+        memcpy(word, q->words + q->woff[i], len);
+        word[len] = 0;
+        uint32_t freq = get_refcount_freq(rc, word);
+        if (q->freq[i] != freq)
+        {
+            fprintf(stderr, "%s ERROR: %s: different frequency for '%.40s' (chunk size %" PRIu64 "): %" PRIu32 " != %" PRIu32 "\n", __func__, name, word, chunk, q->freq[i], freq);
+            ++errors;
+        }
+        free(word);
+    }
+    free_query(q);
+    return errors;
+}
+
+#ifdef HAVE_ZLIB
+// Compress the data and parse it with the decoder thread, using the specified block size.
+int test_diff_gzip(const refcount_t *rc, const uint8_t *src, uint64_t size, size_t blksize, const char *name)
+{
+    uint64_t gzsize = 0;
+    uint8_t *gz = compress_data(src, size, COMP_GZIP, &gzsize);
+    trie_node_t *root = new_trie_node();
+    hifreq_t *hf = new_hifreq(10);
+    if (!gz || (gzsize == 0) || !root || !hf)
+    {
+        fprintf(stderr, "%s ERROR: Unable to compress the data.\n", __func__);
+        return 1;
+    }
+    int errors = 0;
+    int e = parse_input(gz, gzsize, root, hf, blksize);
+    if (e != DECOMP_OK)
+    {
+        fprintf(stderr, "%s ERROR: %s: decoder error: %s\n", __func__, name, decomp_strerror(e));
+        ++errors;
+    }
+    else
+    {
+        errors += check_refcount_trie(rc, root, name);
+        errors += check_refcount_hifreq(rc, hf, name);
+    }
+    free_hifreq(hf);
+    free_trie_node(root);
+    free(gz);
+    return errors;
+}
+#endif
+
+// Run all the engines on the input data.
+int test_diff(const uint8_t *src, uint64_t size, const char *name)
+{
+    refcount_t *rc = new_refcount(src, size);
+    if (!rc)
+    {
+        fprintf(stderr, "%s ERROR: Unable to allocate memory.\n", __func__);
+        return 1;
+    }
+    int errors = 0;
+    uint8_t ks[] = {1, 10, 255};
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        errors += test_diff_chunk(rc, src, size, (size > 0) ? size : 1, ks[i], name);
+    }
+    uint64_t chunks[] = {0, 1, 2, 3, 7, 64, 4096};
+    for (uint8_t i = 0; i < 7; i++)
+    {
+        errors += test_diff_chunk(rc, src, size, chunks[i], 10, name);
+    }
+    for (uint8_t i = 1; i < 7; i++)
+    {
+        errors += test_diff_query(rc, src, size, chunks[i], name);
+    }
+#ifdef HAVE_ZLIB
+    errors += test_diff_gzip(rc, src, size, 1, name);
+    errors += test_diff_gzip(rc, src, size, 7, name);
+    errors += test_diff_gzip(rc, src, size, DECOMP_BLOCK_SIZE, name);
+#endif
+    free_refcount(rc);
+    return errors;
+}
+
+// Generate random words from a small alphabet, so the same words are repeated many times.
+static uint64_t gen_words(uint8_t *dst, uint64_t size, uint64_t *seed, uint8_t nletters, uint8_t maxlen)
+{
+    const char *sep = " \n\t.,;:'\"-!?0123456789\xe2\x80\x99\xff";
+    uint64_t pos = 0;
+    while (pos < size)
+    {
+        uint64_t len = 1 + (rnd(seed) % maxlen);
+        for (uint64_t i = 0; (i < len) && (pos < size); i++)
+        {
+            uint8_t c = (uint8_t)('a' + (rnd(seed) % nletters));
+            dst[pos++] = (rnd(seed) & 1) ? c : (uint8_t)(c - 'a' + 'A');
+        }
+        len = 1 + (rnd(seed) % 3);
+        for (uint64_t i = 0; (i < len) && (pos < size); i++)
+        {
+            dst[pos++] = (uint8_t)sep[rnd(seed) % strlen(sep)];
+        }
+    }
+    return pos;
+}
+
+int test_diff_generated()
+{
+    int errors = 0;
+    uint64_t seed = DIFF_SEED;
+    uint64_t size = 1 << 16;
+    uint8_t *src = (uint8_t *)calloc(size, 1);
+    if (!src)
+    {
+        fprintf(stderr, "%s ERROR: Unable to allocate memory.\n", __func__);
+        return 1;
+    }
+
+    errors += test_diff(src, 0, "empty");
+
+    memset(src, ' ', 1000);
+    errors += test_diff(src, 1000, "separators");
+
+    for (uint64_t i = 0; i < 256; i++)
+    {
+        src[i] = (uint8_t)i;
+    }
+    errors += test_diff(src, 256, "all bytes");
+
+    memcpy(src, "a", 1);
+    errors += test_diff(src, 1, "single letter");
+
+    for (uint64_t i = 0; i < size; i++)
+    {
+        src[i] = (uint8_t)rnd(&seed);
+    }
+    errors += test_diff(src, size, "random bytes");
+
+    // very long words, deeper than the hifreq word buffer
+    memset(src, 'x', 10000);
+    src[10000] = ' ';
+    memset(src + 10001, 'X', 10000);
+    src[20001] = '\n';
+    memset(src + 20002, 'x', 9999);
+    errors += test_diff(src, 30001, "long words");
+
+    for (uint8_t n = 1; n <= 26; n += 5)
+    {
+        uint64_t len = gen_words(src, size, &seed, n, 12);
+        errors += test_diff(src, len, "small alphabet");
+    }
+
+    // many distinct words with the same frequency
+    uint64_t len = 0;
+    for (uint32_t i = 0; (i < 2000) && (len < (size - 16)); i++)
+    {
+        for (uint32_t j = i; j > 0; j /= 26)
+        {
+            src[len++] = (uint8_t)('a' + (j % 26));
+        }
+        src[len++] = ' ';
+    }
+    errors += test_diff(src, len, "ties");
+
+    free(src);
+    return errors;
+}
+
+int test_diff_file(const char *file)
+{
+    mmfile_t mf = {0,0,0};
+    mmap_file(file, &mf);
+    if ((mf.fd < 0) || (mf.src == MAP_FAILED))
+    {
+        fprintf(stderr, "%s ERROR: can't map '%s' file.\n", __func__, file);
+        return 1;
+    }
+    int errors = test_diff(mf.src, mf.size, file);
+    close_mmfile(mf);
+    return errors;
+}
+
+int main()
+{
+    int errors = 0;
+
+    errors += test_diff_generated();
+    errors += test_diff_file("empty.txt");
+    errors += test_diff_file("test01.txt");
+    errors += test_diff_file("mobydick.txt");
+
+    return errors;
+}
@@ -12,6 +12,7 @@
 #include <errno.h>
 #include <sys/mman.h>
 #include "../src/mmap.h"
+#include "testutil.h"
 
 int test_mmap_file_error(const char* file)
 {
@@ -67,6 +68,53 @@ int test_mmap_file()
     return errors;
 }
 
+int test_mmap_file_empty()
+{
+    // empty files are opened but not mapped
+    mmfile_t mf = {0};
+    mmap_file("empty.txt", &mf);
+    if ((mf.fd < 0) || (mf.size != 0) || (mf.src == MAP_FAILED))
+    {
+        fprintf(stderr, "%s can't open empty.txt for reading\n", __func__);
+        return 1;
+    }
+    int e = close_mmfile(mf);
+    if (e != 0)
+    {
+        fprintf(stderr, "%s close error! [%s]\n", __func__, strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+int test_mmap_file_pipe()
+{
+    // pipes report a zero size, but they are not empty files
+    int fds[2];
+    char path[32];
+    if (new_pipe(fds, path, sizeof(path)) != 0)
+    {
+        fprintf(stderr, "%s can't create the pipe\n", __func__);
+        return 1;
+    }
+    int errors = 0;
+    mmfile_t mf = {0};
+    mmap_file(path, &mf);
+    if ((mf.fd < 0) || (mf.src != MAP_FAILED))
+    {
+        fprintf(stderr, "%s An mmap error was expected\n", __func__);
+        ++errors;
+    }
+    if ((mf.fd >= 0) && (close_mmfile(mf) != 0))
+    {
+        fprintf(stderr, "%s close error! [%s]\n", __func__, strerror(errno));
+        ++errors;
+    }
+    close(fds[0]);
+    close(fds[1]);
+    return errors;
+}
+
 int main()
 {
     int errors = 0;
@@ -75,6 +123,8 @@ int main()
     errors += test_mmap_file_error("/dev/null");
     errors += test_munmap_file_error();
     errors += test_mmap_file();
+    errors += test_mmap_file_empty();
+    errors += test_mmap_file_pipe();
 
     return errors;
 }
@@ -0,0 +1,147 @@
+// Nicola Asuni
+
+#if __STDC_VERSION__ >= 199901L
+#define _XOPEN_SOURCE 600
+#else
+#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "../src/outbuf.h"
+
+int test_format_uint32(uint32_t v, const char *expected)
+{
+    char buf[11];
+    uint8_t len = format_uint32(buf, v);
+    buf[len] = 0;
+    if ((len != strlen(expected)) || (strcmp(buf, expected) != 0))
+    {
+        fprintf(stderr, "%s ERROR: expected '%s', got '%s'\n", __func__, expected, buf);
+        return 1;
+    }
+    return 0;
+}
+
+int test_get_format()
+{
+    int errors = 0;
+    const char *names[] = {"txt", "tsv", "csv", "json", "bin"};
+    for (uint8_t i = 0; i < FORMAT_INVALID; i++)
+    {
+        if (get_format(names[i]) != i)
+        {
+            fprintf(stderr, "%s ERROR: unexpected format code for '%s'\n", __func__, names[i]);
+            ++errors;
+        }
+    }
+    if (get_format("xml") != FORMAT_INVALID)
+    {
+        fprintf(stderr, "%s ERROR: FORMAT_INVALID expected\n", __func__);
+        ++errors;
+    }
+    return errors;
+}
+
+int test_outbuf(uint8_t format, size_t size, const char *expected, size_t explen)
+{
+    FILE *f = tmpfile();
+    if (!f)
+    {
+        fprintf(stderr, "%s ERROR: tmpfile [%s]\n", __func__, strerror(errno));
+        return 1;
+    }
+    outbuf_t *ob = new_outbuf(fileno(f), format, size);
+    if (!ob)
+    {
+        fprintf(stderr, "%s ERROR: Unable to allocate memory.\n", __func__);
+        fclose(f);
+        return 1;
+    }
+    char longword[100];
+    memset(longword, 'x', sizeof(longword));
+    outbuf_begin(ob);
+    outbuf_record(ob, 4284, "the", 3);
+    outbuf_record(ob, 7, "wordfreq", 8);
+    outbuf_record(ob, 4294967295, longword, sizeof(longword));
+    int e = outbuf_end(ob);
+    free_outbuf(ob);
+    if (e != 0)
+    {
+        fprintf(stderr, "%s ERROR: write [%s]\n", __func__, strerror(e));
+        fclose(f);
+        return 1;
+    }
+    char out[1024];
+    rewind(f);
+    size_t len = fread(out, 1, sizeof(out), f);
+    fclose(f);
+    if ((len != explen) || (memcmp(out, expected, len) != 0))
+    {
+        fprintf(stderr, "%s ERROR: unexpected output for format %" PRIu8 " and size %zu:\n%.*s\n", __func__, format, size, (int)len, out);
+        return 1;
+    }
+    return 0;
+}
+
+int test_write_error()
+{
+    outbuf_t *ob = new_outbuf(-1, FORMAT_TXT, OUTBUF_SIZE);
+    if (!ob)
+    {
+        fprintf(stderr, "%s ERROR: Unable to allocate memory.\n", __func__);
+        return 1;
+    }
+    outbuf_begin(ob);
+    outbuf_record(ob, 1, "a", 1);
+    int e = outbuf_end(ob);
+    free_outbuf(ob);
+    if (e == 0)
+    {
+        fprintf(stderr, "%s ERROR: A write error was expected\n", __func__);
+        return 1;
+    }
+    return 0;
+}
+
+int main()
+{
+    int errors = 0;
+
+    errors += test_format_uint32(0, "0");
+    errors += test_format_uint32(9, "9");
+    errors += test_format_uint32(10, "10");
+    errors += test_format_uint32(99, "99");
+    errors += test_format_uint32(100, "100");
+    errors += test_format_uint32(12345, "12345");
+    errors += test_format_uint32(4294967295, "4294967295");
+
+    errors += test_get_format();
+
+    const char *x100 = "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx";
+    char exp[5][512];
+    snprintf(exp[FORMAT_TXT], sizeof(exp[0]), "      4284 the\n         7 wordfreq\n4294967295 %s\n", x100);
+    snprintf(exp[FORMAT_TSV], sizeof(exp[0]), "4284\tthe\n7\twordfreq\n4294967295\t%s\n", x100);
+    snprintf(exp[FORMAT_CSV], sizeof(exp[0]), "4284,the\n7,wordfreq\n4294967295,%s\n", x100);
+    snprintf(exp[FORMAT_JSON], sizeof(exp[0]), "[\n{\"count\":4284,\"word\":\"the\"},\n{\"count\":7,\"word\":\"wordfreq\"},\n{\"count\":4294967295,\"word\":\"%s\"}\n]\n", x100);
+    char bin[] = "\xbc\x10\x00\x00\x03\x00\x00\x00the\x07\x00\x00\x00\x08\x00\x00\x00wordfreq\xff\xff\xff\xff\x64\x00\x00\x00";
+    size_t binlen = sizeof(bin) - 1;
+    memcpy(exp[FORMAT_BIN], bin, binlen);
+    memcpy(exp[FORMAT_BIN] + binlen, x100, 100);
+    binlen += 100;
+
+    size_t sizes[] = {OUTBUF_SIZE, 64, 0};
+    for (uint8_t s = 0; s < 3; s++)
+    {
+        for (uint8_t f = FORMAT_TXT; f < FORMAT_BIN; f++)
+        {
+            errors += test_outbuf(f, sizes[s], exp[f], strlen(exp[f]));
+        }
+        errors += test_outbuf(FORMAT_BIN, sizes[s], exp[FORMAT_BIN], binlen);
+    }
+
+    errors += test_write_error();
+
+    return errors;
+}
@@ -0,0 +1,155 @@
+// Nicola Asuni
+
+#if __STDC_VERSION__ >= 199901L
+#define _XOPEN_SOURCE 600
+#else
+#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "../src/query.h"
+#include "testutil.h"
+
+// Returns the frequency of a word stored in the trie.
+static uint32_t get_trie_freq(const trie_node_t *root, const char *word, size_t len)
+{
+    const trie_node_t *node = root;
+    for (size_t i = 0; (i < len) && node; i++)
+    {
+        node = node->child[get_char_index((uint8_t)word[i])];
+    }
+    return (node && node->isend) ? node->freq : 0;
+}
+
+int test_new_query()
+{
+    const char *list = "The, whale\nthe ahab\n\nAHAB zzzq a ab";
+    const char *words[] = {"the", "whale", "ahab", "zzzq", "a", "ab"};
+    query_t *q = new_query((const uint8_t *)list, strlen(list));
+    if (!q)
+    {
+        fprintf(stderr, "%s ERROR: Unable to allocate memory.\n", __func__);
+        return 1;
+    }
+    int errors = 0;
+    if (q->nwords != 6)
+    {
+        fprintf(stderr, "%s ERROR: expected 6 distinct words, got %" PRIu32 "\n", __func__, q->nwords);
+        ++errors;
+    }
+    for (uint32_t i = 1; (i <= q->nwords) && (i <= 6); i++)
+    {
+        size_t len = (size_t)(q->woff[i + 1] - q->woff[i]);
+        if ((len != strlen(words[i - 1])) || (memcmp(q->words + q->woff[i], words[i - 1], len) != 0))
+        {
+            fprintf(stderr, "%s ERROR: unexpected word (%" PRIu32 "): %.*s\n", __func__, i, (int)len, q->words + q->woff[i]);
+            ++errors;
+        }
+    }
+    free_query(q);
+    return errors;
+}
+
+// Count the query words in the file, split in chunks of the specified size,
+// and compare the results with the full trie built by parse_data().
+int test_query_chunk(const char *file, const char *list, uint64_t chunk)
+{
+    mmfile_t mf = {0,0,0};
+    mmap_file(file, &mf);
+    if ((mf.fd < 0) || (mf.size == 0) || (mf.src == MAP_FAILED))
+    {
+        fprintf(stderr, "%s ERROR: can't map '%s' file.\n", __func__, file);
+        return 1;
+    }
+    query_t *q = new_query((const uint8_t *)list, strlen(list));
+    trie_node_t *root = new_trie_node();
+    hifreq_t *hf = new_hifreq(1);
+    if (!q || !root || !hf)
+    {
+        fprintf(stderr, "%s ERROR: Unable to allocate memory.\n", __func__);
+        return 1;
+    }
+    uint32_t state = QUERY_ROOT;
+    for (uint64_t pos = 0; pos < mf.size; pos += chunk)
+    {
+        query_chunk(q, &state, mf.src + pos, ((mf.size - pos) < chunk) ? (mf.size - pos) : chunk);
+    }
+    query_finish(q, &state);
+    parse_data(mf.src, mf.size, root, hf);
+    int errors = 0;
+    for (uint32_t i = 1; i <= q->nwords; i++)
+    {
+        const char *word = q->words + q->woff[i];
+        size_t len = (size_t)(q->woff[i + 1] - q->woff[i]);
+        uint32_t freq = get_trie_freq(root, word, len);
+        if (q->freq[i] != freq)
+        {
+            fprintf(stderr, "%s ERROR: different frequency for '%.*s' in %s: %" PRIu32 " != %" PRIu32 ".\n", __func__, (int)len, word, file, q->freq[i], freq);
+            ++errors;
+        }
+    }
+    free_hifreq(hf);
+    free_trie_node(root);
+    free_query(q);
+    munmap_file(mf);
+    return errors;
+}
+
+int test_wordfreq_query()
+{
+    int errors = 0;
+    if (wordfreq_query("test01.txt", "test01.txt", FORMAT_TSV) != 0)
+    {
+        fprintf(stderr, "%s ERROR: unexpected error\n", __func__);
+        ++errors;
+    }
+    if ((wordfreq_query("empty.txt", "test01.txt", FORMAT_JSON) != 0) || (wordfreq_query("test01.txt", "empty.txt", FORMAT_JSON) != 0))
+    {
+        fprintf(stderr, "%s ERROR: unexpected error with empty files\n", __func__);
+        ++errors;
+    }
+    if (wordfreq_query("test01.txt", "ERROR", FORMAT_TSV) == 0)
+    {
+        fprintf(stderr, "%s ERROR: an error was expected for a missing query file\n", __func__);
+        ++errors;
+    }
+    int fds[2];
+    char path[32];
+    if (new_pipe(fds, path, sizeof(path)) == 0)
+    {
+        if ((wordfreq_query(path, "test01.txt", FORMAT_TSV) != 2) || (wordfreq_query("test01.txt", path, FORMAT_TSV) != 9))
+        {
+            fprintf(stderr, "%s ERROR: an error was expected for a pipe\n", __func__);
+            ++errors;
+        }
+        close(fds[0]);
+        close(fds[1]);
+    }
+    if (wordfreq_query("ERROR", "test01.txt", FORMAT_TSV) == 0)
+    {
+        fprintf(stderr, "%s ERROR: an error was expected for a missing input file\n", __func__);
+        ++errors;
+    }
+    return errors;
+}
+
+int main()
+{
+    int errors = 0;
+
+    errors += test_new_query();
+
+    const char *list = "the whale ahab zzzq a i of sea moby dick ca car cars carsic c abcdefghijklmnopqrstuvwxyz abcd ten";
+    uint64_t chunks[] = {1, 3, 4096, 1 << 30};
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        errors += test_query_chunk("mobydick.txt", list, chunks[i]);
+        errors += test_query_chunk("test01.txt", list, chunks[i]);
+    }
+
+    errors += test_wordfreq_query();
+
+    return errors;
+}
@@ -7,13 +7,33 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
+
+// Allocation failure injection: malloc() fails after the specified number of calls (-1 = never).
+static int64_t malloc_left = -1;
+
+static void *test_malloc(size_t size)
+{
+    if (malloc_left == 0)
+    {
+        return NULL;
+    }
+    if (malloc_left > 0)
+    {
+        --malloc_left;
+    }
+    return malloc(size);
+}
+
+#define malloc test_malloc
 #include "../src/wordfreq.h"
+#include "testutil.h"
 
-int test_wordfreq()
+int test_wordfreq(uint8_t format, bool all)
 {
-    int e = wordfreq("test01.txt", 10);
+    int e = wordfreq("test01.txt", 10, format, all);
     if (e != 0)
     {
         fprintf(stderr, "%s worfreq error: %d\n", __func__, e);
@@ -22,6 +42,44 @@ int test_wordfreq()
     return 0;
 }
 
+int test_wordfreq_empty()
+{
+    // an empty input is valid and contains no words
+    int errors = 0;
+    for (uint8_t format = FORMAT_TXT; format < FORMAT_INVALID; format++)
+    {
+        int e = wordfreq("empty.txt", 10, format, (format == FORMAT_TXT));
+        if (e != 0)
+        {
+            fprintf(stderr, "%s worfreq error: %d\n", __func__, e);
+            ++errors;
+        }
+    }
+    return errors;
+}
+
+int test_wordfreq_pipe()
+{
+    // a pipe is not an empty file: an error is expected instead of an empty output
+    int fds[2];
+    char path[32];
+    if (new_pipe(fds, path, sizeof(path)) != 0)
+    {
+        fprintf(stderr, "%s ERROR: can't create the pipe\n", __func__);
+        return 1;
+    }
+    int errors = 0;
+    int e = wordfreq(path, 10, FORMAT_TXT, false);
+    if (e != 2)
+    {
+        fprintf(stderr, "%s ERROR: expected error 2, got %d\n", __func__, e);
+        ++errors;
+    }
+    close(fds[0]);
+    close(fds[1]);
+    return errors;
+}
+
 int test_parse_data(const char *file, uint32_t *freq, uint8_t k)
 {
     // memory-map the input file
@@ -91,11 +149,223 @@ int test_parse_data(const char *file, uint32_t *freq, uint8_t k)
     return errors;
 }
 
+int test_trie_iter(const uint8_t *src, uint64_t size, uint64_t nwords, uint64_t maxlen)
+{
+    trie_node_t *root = new_trie_node();
+    hifreq_t *hf = new_hifreq(1);
+    if (!root || !hf)
+    {
+        fprintf(stderr, "%s ERROR: Unable to allocate memory.\n", __func__);
+        return 1;
+    }
+    parse_data(src, size, root, hf);
+    trie_iter_t it;
+    if (init_trie_iter(&it, root) != 0)
+    {
+        fprintf(stderr, "%s ERROR: Unable to allocate memory.\n", __func__);
+        return 1;
+    }
+    int errors = 0;
+    uint64_t count = 0;
+    uint64_t max = 0;
+    char *prev = (char *)calloc(maxlen + 1, 1);
+    const char *word;
+    uint32_t freq = 0;
+    uint64_t len = 0;
+    while ((word = trie_iter_next(&it, &freq, &len)) != NULL)
+    {
+        if ((len != strlen(word)) || (freq == 0) || (len > maxlen) || (prev && (count > 0) && (strcmp(prev, word) >= 0)))
+        {
+            fprintf(stderr, "%s ERROR: unexpected word (%" PRIu64 "): %s\n", __func__, count, word);
+            ++errors;
+        }
+        if (prev && (len <= maxlen))
+        {
+            memcpy(prev, word, len + 1);
+        }
+        max = (len > max) ? len : max;
+        count += freq;
+    }
+    if (it.err || (count != nwords) || (max != maxlen))
+    {
+        fprintf(stderr, "%s ERROR: expected %" PRIu64 " words (max length %" PRIu64 "), got %" PRIu64 " (max length %" PRIu64 ")\n", __func__, nwords, maxlen, count, max);
+        ++errors;
+    }
+    free(prev);
+    free_trie_iter(&it);
+    free_hifreq(hf);
+    free_trie_node(root);
+    return errors;
+}
+
+int test_trie_iter_file(const char *file, uint64_t nwords, uint64_t maxlen)
+{
+    mmfile_t mf = {0,0,0};
+    mmap_file(file, &mf);
+    if ((mf.fd < 0) || (mf.size == 0) || (mf.src == MAP_FAILED))
+    {
+        fprintf(stderr, "%s ERROR: can't map '%s' file.\n", __func__, file);
+        return 1;
+    }
+    int errors = test_trie_iter(mf.src, mf.size, nwords, maxlen);
+    munmap_file(mf);
+    return errors;
+}
+
+// Print the parsed words in TSV format to a temporary file and read the output back.
+static size_t print_tsv(const trie_node_t *root, const hifreq_t *hf, bool all, char *out, size_t size)
+{
+    FILE *f = tmpfile();
+    if (!f)
+    {
+        return 0;
+    }
+    outbuf_t *ob = new_outbuf(fileno(f), FORMAT_TSV, OUTBUF_SIZE);
+    size_t len = 0;
+    if (ob)
+    {
+        outbuf_begin(ob);
+        int e = 0;
+        if (all)
+        {
+            e = print_trie(root, ob);
+        }
+        else
+        {
+            print_hifreq(hf, ob);
+        }
+        if ((outbuf_end(ob) == 0) && (e == 0))
+        {
+            rewind(f);
+            len = fread(out, 1, size, f);
+        }
+        free_outbuf(ob);
+    }
+    fclose(f);
+    return len;
+}
+
+int test_long_word()
+{
+    // the top-k output truncates the words to MAX_WORD_LENGTH - 1 characters, the --all output prints them in full
+    const size_t wlen = 300;
+    const size_t tlen = MAX_WORD_LENGTH - 1;
+    char src[1024];
+    memset(src, 'x', wlen);
+    memcpy(src + wlen, " ab ", 4);
+    memset(src + wlen + 4, 'X', wlen);
+    memcpy(src + (2 * wlen) + 4, " ab ab\n", 7);
+    size_t size = (2 * wlen) + 11;
+    trie_node_t *root = new_trie_node();
+    hifreq_t *hf = new_hifreq(10);
+    if (!root || !hf)
+    {
+        fprintf(stderr, "%s ERROR: Unable to allocate memory.\n", __func__);
+        return 1;
+    }
+    parse_data((const uint8_t *)src, size, root, hf);
+    int errors = 0;
+    char exp[1024];
+    char out[1024];
+    memcpy(exp, "3\tab\n2\t", 7);
+    memset(exp + 7, 'x', wlen);
+    exp[7 + wlen] = '\n';
+    size_t len = print_tsv(root, hf, true, out, sizeof(out));
+    if ((len != (wlen + 8)) || (memcmp(out, exp, len) != 0))
+    {
+        fprintf(stderr, "%s ERROR: unexpected --all output:\n%.*s\n", __func__, (int)len, out);
+        ++errors;
+    }
+    exp[7 + tlen] = '\n';
+    len = print_tsv(root, hf, false, out, sizeof(out));
+    if ((len != (tlen + 8)) || (memcmp(out, exp, len) != 0))
+    {
+        fprintf(stderr, "%s ERROR: unexpected top-k output:\n%.*s\n", __func__, (int)len, out);
+        ++errors;
+    }
+    free_hifreq(hf);
+    free_trie_node(root);
+    return errors;
+}
+
+int test_parse_data_nomem(const char *file)
+{
+    mmfile_t mf = {0,0,0};
+    mmap_file(file, &mf);
+    if ((mf.fd < 0) || (mf.size == 0) || (mf.src == MAP_FAILED))
+    {
+        fprintf(stderr, "%s ERROR: can't map '%s' file.\n", __func__, file);
+        return 1;
+    }
+    trie_node_t *root = new_trie_node();
+    hifreq_t *hf = new_hifreq(10);
+    if (!root || !hf)
+    {
+        fprintf(stderr, "%s ERROR: Unable to allocate memory.\n", __func__);
+        return 1;
+    }
+    int errors = 0;
+    malloc_left = 1000;
+    if (parse_data(mf.src, mf.size, root, hf) != 1)
+    {
+        fprintf(stderr, "%s ERROR: a memory allocation error was expected\n", __func__);
+        ++errors;
+    }
+    malloc_left = -1;
+    // the partial trie is still consistent
+    uint64_t count = 0;
+    trie_iter_t it;
+    if (init_trie_iter(&it, root) == 0)
+    {
+        uint32_t freq = 0;
+        uint64_t len = 0;
+        while (trie_iter_next(&it, &freq, &len) != NULL)
+        {
+            count += freq;
+        }
+        free_trie_iter(&it);
+    }
+    if ((count == 0) || (hf->count != 10))
+    {
+        fprintf(stderr, "%s ERROR: unexpected partial results: %" PRIu64 " words\n", __func__, count);
+        ++errors;
+    }
+    free_hifreq(hf);
+    free_trie_node(root);
+    munmap_file(mf);
+    return errors;
+}
+
+int test_trie_iter_deep()
+{
+    // long runs of letters produce a very deep trie
+    uint64_t size = 100001;
+    uint8_t *src = (uint8_t *)malloc(size);
+    if (!src)
+    {
+        fprintf(stderr, "%s ERROR: Unable to allocate memory.\n", __func__);
+        return 1;
+    }
+    memset(src, 'a', size);
+    src[50000] = ' ';
+    src[size - 2] = ' ';
+    src[size - 1] = 'b';
+    int errors = test_trie_iter(src, size, 3, 50000);
+    free(src);
+    return errors;
+}
+
 int main()
 {
     int errors = 0;
 
-    errors += test_wordfreq();
+    for (uint8_t format = FORMAT_TXT; format < FORMAT_INVALID; format++)
+    {
+        errors += test_wordfreq(format, false);
+    }
+    errors += test_wordfreq(FORMAT_TXT, true);
+    errors += test_wordfreq_empty();
+    errors += test_wordfreq_pipe();
 
     uint32_t freq[] =
     {
@@ -112,6 +382,7 @@ int main()
         108,  107,  104,  104,  101,  101,  100,   98,  97,  97,
     };
     errors += test_parse_data("mobydick.txt", freq, 100);
+    errors += test_parse_data("mobydick.txt", freq, 1);
 
     uint32_t freq2[] =
     {
@@ -120,5 +391,11 @@ int main()
     };
     errors += test_parse_data("test01.txt", freq2, 10);
 
+    errors += test_trie_iter_file("test01.txt", 89, 305);
+    errors += test_trie_iter_file("mobydick.txt", 74819, 17);
+    errors += test_trie_iter_deep();
+    errors += test_long_word();
+    errors += test_parse_data_nomem("mobydick.txt");
+
     return errors;
 }
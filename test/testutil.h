@@ -0,0 +1,92 @@
+// Nicola Asuni
+
+/**
+ * @file testutil.h
+ * @brief Fixtures shared by the unit tests.
+ */
+
+#ifndef WORDFREQ_TESTUTIL_H
+#define WORDFREQ_TESTUTIL_H
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "../src/decomp.h"
+
+/**
+ * Compress the input data, returning a newly allocated buffer.
+ *
+ * @param src     Pointer to the input data.
+ * @param size    Input data size in bytes.
+ * @param type    Compression format (COMP_GZIP or COMP_ZSTD).
+ * @param outsize Returns the compressed data size in bytes (0 in case of error).
+ *
+ * @return Compressed data, or NULL if the format is not supported or in case of error.
+ */
+static inline uint8_t *compress_data(const uint8_t *src, uint64_t size, uint8_t type, uint64_t *outsize)
+{
+    *outsize = 0;
+#ifdef HAVE_ZLIB
+    if (type == COMP_GZIP)
+    {
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            return NULL;
+        }
+        uLong bound = deflateBound(&zs, (uLong)size);
+        uint8_t *dst = (uint8_t *)malloc(bound);
+        if (dst)
+        {
+            zs.next_in = (Bytef *)(uintptr_t)src;
+            zs.avail_in = (uInt)size;
+            zs.next_out = dst;
+            zs.avail_out = (uInt)bound;
+            deflate(&zs, Z_FINISH);
+            *outsize = zs.total_out;
+        }
+        deflateEnd(&zs);
+        return dst;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (type == COMP_ZSTD)
+    {
+        size_t bound = ZSTD_compressBound((size_t)size);
+        uint8_t *dst = (uint8_t *)malloc(bound);
+        if (dst)
+        {
+            size_t n = ZSTD_compress(dst, bound, src, (size_t)size, 3);
+            *outsize = ZSTD_isError(n) ? 0 : n;
+        }
+        return dst;
+    }
+#endif
+    (void)src;
+    (void)size;
+    (void)type;
+    return NULL;
+}
+
+/**
+ * Create a pipe containing some words, to be opened through its /dev/fd path
+ * like the shell process substitution does.
+ *
+ * @param fds  Returns the read and write ends of the pipe.
+ * @param path Returns the /dev/fd path of the read end.
+ * @param size Size of the path buffer.
+ *
+ * @return 0 in case of success, 1 in case of error.
+ */
+static inline int new_pipe(int fds[2], char *path, size_t size)
+{
+    if ((pipe(fds) != 0) || (write(fds[1], "one two two\n", 12) != 12))
+    {
+        return 1;
+    }
+    snprintf(path, size, "/dev/fd/%d", fds[0]);
+    return 0;
+}
+
+#endif  // WORDFREQ_TESTUTIL_H